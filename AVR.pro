@@ -1,6 +1,15 @@
 TEMPLATE = subdirs
 
 SUBDIRS += \
-    ./AVR_Emulator \
-    ./AVR_Testing
+    AVR_Client \
+    AVR_Emulator \
+    AVR_Emulator_headless \
+    AVR_Testing \
+    AVR_Bench \
+    AVR_LoadGen \
+    AVR_Check
 
+#Client library is linked statically, so it must be built before its users
+AVR_Testing.depends = AVR_Client
+AVR_LoadGen.depends = AVR_Client
+AVR_Check.depends = AVR_Client
@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Microbenchmarks of AVR protocol message path.
+# Console application, prints messages per second of every measured stage.
+# Stage benchmarks run real emulator core, so it's linked in.
+#
+#-------------------------------------------------
+
+QT       -= gui
+
+TARGET = AVR_Bench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../AVR_Emulator/avrcore.pri)
+
+SOURCES += \
+        main.cpp \
+    stagebench.cpp
+
+HEADERS += \
+    stagebench.h
+
+DESTDIR = ../bin/bench
+OBJECTS_DIR = ../bin/bench/.obj
+MOC_DIR = ../bin/bench/.moc
+RCC_DIR = ../bin/bench/.rcc
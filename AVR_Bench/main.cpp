@@ -0,0 +1,222 @@
+#include <QCoreApplication>
+#include <QByteArray>
+#include <QDataStream>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <cstdio>
+#include "avrprotocol.h"
+#include "avrtextprotocol.h"
+#include "stagebench.h"
+
+//Microbenchmarks of AVR protocol parsers. Every benchmark parses the same stream of messages
+//by legacy QString based code and by in-place parser, and prints how many messages per second it handles.
+//Encoding benchmark writes the same replies by legacy QDataStream code and by in-place encoder.
+//After them stages of command's path through emulator are measured (see stagebench.cpp).
+
+namespace
+{
+    const int messageCount = 1000000;   //Messages in one benchmark run
+    const int stageRuns = 5;            //Runs of every stage benchmark, median of them is reported
+
+    //Forms stream of text blocks as client (or server) sends them
+    QByteArray MakeTextStream(const QStringList& messages)
+    {
+        QByteArray stream;
+        for (int i = 0; i < messageCount; i++)
+        {
+            QByteArray arrBlock;
+            QDataStream out(&arrBlock, QIODevice::WriteOnly);
+            out.setVersion(QDataStream::Qt_5_3);
+            out << quint16(0) << messages[i % messages.size()];
+            out.device()->seek(0);
+            out << quint16(arrBlock.size() - sizeof(quint16));
+            stream += arrBlock;
+        }
+        return stream;
+    }
+
+    //Legacy Server::FormMessage() code
+    qint64 LegacyParseCommand(const QString& str)
+    {
+        int delimiterPos = str.indexOf(":", 0);
+        if(delimiterPos != -1)
+        {
+            QString tmp;
+            int msg, pos;
+            tmp = str.left(delimiterPos);
+            msg = tmp.toInt();
+            tmp = str.right(str.length() - (delimiterPos + 1));
+            pos = tmp.toInt();
+            return msg + pos;
+        }
+        else
+            return str.toInt();
+    }
+
+    //Legacy Client::HandleServerMessage() parsing code (without writing to log)
+    qint64 LegacyParseReply(const QString& message)
+    {
+        QString str, tmp;
+        str = message;
+        int delimiterPos;
+        if (str[0] != '\\')
+            return 0;
+        switch(str[1].toLatin1())
+        {
+            case 'p':
+                return str.right(str.length() - 2).toInt();
+            case 'i':
+                str = str.right(str.length() - 2);
+                delimiterPos = str.indexOf(":", 0);
+                tmp = str.left(delimiterPos);
+                return tmp.toInt() + str.right(str.length() - (delimiterPos + 1)).toInt();
+            case 'r':
+                str = str.right(str.length() - 2);
+                if(str[0] == '1' && str[1] == ':' && str[2] != '\0')
+                    return str.right(str.length() - 2).toInt();
+                return QString(str[0]).toInt();
+        }
+        return 0;
+    }
+
+    //Reads stream by QDataStream into QString, as legacy server and client did
+    template<class Parser>
+    qint64 RunLegacy(const QByteArray& stream, Parser parse)
+    {
+        QBuffer buffer;
+        buffer.setData(stream);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream in(&buffer);
+        in.setVersion(QDataStream::Qt_5_3);
+        qint64 checksum = 0;
+        while (!in.atEnd())
+        {
+            quint16 blockSize;
+            QString str;
+            in >> blockSize >> str;
+            checksum += parse(str);
+        }
+        return checksum;
+    }
+
+    //Reads stream in place through MessageView, as server and client do now
+    template<class Parser>
+    qint64 RunInPlace(const QByteArray& stream, Parser parse)
+    {
+        const uchar* data = reinterpret_cast<const uchar*>(stream.constData());
+        const uchar* end = data + stream.size();
+        qint64 checksum = 0;
+        while (data < end)
+        {
+            quint16 blockSize = qFromBigEndian<quint16>(data);
+            AVR::TextProtocol::MessageView view;
+            AVR::TextProtocol::MessageView::FromBlock(data + 2, blockSize, view);
+            checksum += parse(view);
+            data += 2 + blockSize;
+        }
+        return checksum;
+    }
+
+    void Report(const char* name, qint64 nsecs, qint64 checksum)
+    {
+        double perSecond = messageCount / (nsecs / 1e9);
+        std::printf("%-32s %12.0f msg/s  %8.1f ns/msg  (checksum %lld)\n",
+                    name, perSecond, double(nsecs) / messageCount, (long long)checksum);
+    }
+
+    template<class Benchmark>
+    qint64 Measure(const char* name, Benchmark benchmark)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        qint64 checksum = benchmark();
+        qint64 nsecs = timer.nsecsElapsed();
+        Report(name, nsecs, checksum);
+        return nsecs;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QByteArray commands = MakeTextStream(QStringList() << "1:56" << "2" << "3" << "1:-1200");
+    QByteArray replies = MakeTextStream(QStringList() << "\\p1234" << "\\r1:56" << "\\r3" << "\\i200:15000" << "\\s");
+
+    //Binary records of the same commands
+    QByteArray records(messageCount * AVR::Protocol::RecordSize, 0);
+    for (int i = 0; i < messageCount; i++)
+    {
+        AVR::Protocol::Record record = {AVR::Protocol::Opcode(1 + i % 3), 0, (i % 2) ? 56 : -1200, 0, quint32(i)};
+        AVR::Protocol::Encode(record, reinterpret_cast<uchar*>(records.data()) + i * AVR::Protocol::RecordSize);
+    }
+
+    std::printf("%d messages per run\n\n", messageCount);
+
+    qint64 legacy = Measure("Server command, QString", [&]() {
+        return RunLegacy(commands, LegacyParseCommand);
+    });
+    qint64 inPlace = Measure("Server command, in place", [&]() {
+        return RunInPlace(commands, [](const AVR::TextProtocol::MessageView& view) {
+            AVR::TextProtocol::Command command = AVR::TextProtocol::ParseCommand(view);
+            return qint64(command.code + command.steps);
+        });
+    });
+    qint64 binary = Measure("Server command, binary record", [&]() {
+        const uchar* data = reinterpret_cast<const uchar*>(records.constData());
+        qint64 checksum = 0;
+        for (int i = 0; i < messageCount; i++)
+        {
+            AVR::Protocol::Record record = AVR::Protocol::Decode(data + i * AVR::Protocol::RecordSize);
+            checksum += int(record.opcode) + record.arg0;
+        }
+        return checksum;
+    });
+    std::printf("In-place speedup: %.1fx, binary speedup: %.1fx\n\n", double(legacy) / inPlace, double(legacy) / binary);
+
+    legacy = Measure("Client reply, QString", [&]() {
+        return RunLegacy(replies, LegacyParseReply);
+    });
+    inPlace = Measure("Client reply, in place", [&]() {
+        return RunInPlace(replies, [](const AVR::TextProtocol::MessageView& view) {
+            AVR::TextProtocol::Reply reply = AVR::TextProtocol::ParseReply(view);
+            return qint64(reply.token == 'r' && reply.arg0 == 1 ? reply.arg1 : reply.arg0 + (reply.token == 'i' ? reply.arg1 : 0));
+        });
+    });
+    std::printf("In-place speedup: %.1fx\n\n", double(legacy) / inPlace);
+
+    //Replies are written to one output buffer, as server does between flushes
+    QStringList replyTexts = QStringList() << "\\p1234" << "\\r1:56#17" << "\\t1250" << "\\s#17";
+    QByteArray legacyOutput, inPlaceOutput;
+    legacy = Measure("Server reply encode, QDataStream", [&]() {
+        for (int i = 0; i < messageCount; i++)
+        {
+            if (legacyOutput.size() > 64 * 1024)    //Flushed to socket
+                legacyOutput.clear();
+            QByteArray arrBlock;
+            QDataStream out(&arrBlock, QIODevice::WriteOnly);
+            out.setVersion(QDataStream::Qt_5_3);
+            out << quint16(0) << replyTexts[i % replyTexts.size()];
+            out.device()->seek(0);
+            out << quint16(arrBlock.size() - sizeof(quint16));
+            legacyOutput += arrBlock;
+        }
+        return qint64(legacyOutput.size());
+    });
+    inPlace = Measure("Server reply encode, in place", [&]() {
+        for (int i = 0; i < messageCount; i++)
+        {
+            if (inPlaceOutput.size() > 64 * 1024)
+                inPlaceOutput.clear();
+            AVR::TextProtocol::AppendMessage(inPlaceOutput, replyTexts[i % replyTexts.size()]);
+        }
+        return qint64(inPlaceOutput.size());
+    });
+    std::printf("In-place speedup: %.1fx, output is %s\n\n", double(legacy) / inPlace,
+                legacyOutput == inPlaceOutput ? "identical" : "DIFFERENT");
+
+    AVR::Bench::RunStageBenchmarks(stageRuns);
+    return 0;
+}
@@ -0,0 +1,691 @@
+#include "stagebench.h"
+#include "avrhost.h"
+#include "avrsettings.h"
+#include "avrprotocol.h"
+#include "avrtextprotocol.h"
+#include <QThread>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QBuffer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QLocalSocket>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <vector>
+#include <cstdio>
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#endif
+
+//Stage benchmarks of one command's life in emulator: framing of socket data, decoding of command, hop to AVR System's
+//thread, reply signal back to server's thread and encoding of reply. Every stage is measured alone, than the whole
+//path is measured through real server and AVR System. Throughput stages push many commands at once, round trip
+//stages send next command only when previous one is answered, so they show latency of event loop and transport.
+
+namespace AVR
+{
+    namespace Bench
+    {
+        namespace
+        {
+            const int streamCount = 200000;     //Commands per run of throughput stages
+            const int roundTrips = 20000;       //Commands per run of round trip stages
+            const int runTimeout = 60000;       //Milliseconds. Run which doesn't finish in time fails the stage.
+
+            void Report(const char* name, std::vector<double> results)
+            {
+                if (results.empty())
+                {
+                    std::printf("%-46s FAILED\n", name);
+                    return;
+                }
+                //Median is stable against runs disturbed by other processes, min and max show spread
+                std::sort(results.begin(), results.end());
+                double median = results[results.size() / 2];
+                std::printf("%-46s %10.1f ns/cmd %12.0f cmd/s  (min %.1f, max %.1f)\n",
+                            name, median, 1e9 / median, results.front(), results.back());
+            }
+
+            //Runs stage after warm-up run. run returns nanoseconds spent for count commands, or -1 if it failed.
+            void Stage(const char* name, int runs, int count, const std::function<qint64()>& run)
+            {
+                std::vector<double> results;
+                if (run() >= 0)     //Warm-up: lazy allocations, caches and socket buffers
+                {
+                    for (int i = 0; i < runs; i++)
+                    {
+                        qint64 nsecs = run();
+                        if (nsecs < 0)
+                        {
+                            results.clear();
+                            break;
+                        }
+                        results.push_back(double(nsecs) / count);
+                    }
+                }
+                Report(name, results);
+            }
+
+            //Runs event loop until it's quit by stage, returns false if it timed out
+            bool Exec(QEventLoop& loop)
+            {
+                bool timedOut = false;
+                QTimer::singleShot(runTimeout, &loop, [&]()
+                {
+                    timedOut = true;
+                    loop.quit();
+                });
+                loop.exec();
+                return !timedOut;
+            }
+
+            //Commands as client sends them, alternating moves with request IDs
+            QByteArray MakeCommands(int count)
+            {
+                QByteArray stream;
+                for (int i = 0; i < count; i++)
+                    TextProtocol::AppendMessage(stream, QStringLiteral("1:%1#%2").arg(i % 2 ? 56 : -56).arg(i + 1));
+                return stream;
+            }
+
+            //Framing loop of Server::ReadSession(): splits socket data into blocks right in stack buffer.
+            //handle(block, size) is called for every complete block. Returns count of handled blocks.
+            template<typename Handler>
+            int ReadFrames(QIODevice* device, quint16& nextBlockSize, Handler handle)
+            {
+                uchar block[TextProtocol::MaxBlockSize];
+                int handled = 0;
+                while (true)
+                {
+                    if (!nextBlockSize)
+                    {
+                        if (device->bytesAvailable() < qint64(sizeof(quint16)))
+                            break;
+                        device->read(reinterpret_cast<char*>(block), sizeof(quint16));
+                        nextBlockSize = qFromBigEndian<quint16>(block);
+                    }
+                    if (device->bytesAvailable() < nextBlockSize)
+                        break;
+                    if (nextBlockSize <= TextProtocol::MaxBlockSize)
+                    {
+                        device->read(reinterpret_cast<char*>(block), nextBlockSize);
+                        handle(block, nextBlockSize);
+                    }
+                    else    //Too long block is skipped as server does
+                    {
+                        for (int left = nextBlockSize; left > 0; left -= TextProtocol::MaxBlockSize)
+                            device->read(reinterpret_cast<char*>(block), qMin(left, TextProtocol::MaxBlockSize));
+                    }
+                    nextBlockSize = 0;
+                    handled++;
+                }
+                return handled;
+            }
+
+            //Connected pair of stream sockets. Both ends live in this thread.
+            struct Transport
+            {
+                QIODevice* client = nullptr;
+                QIODevice* server = nullptr;
+                std::function<void()> close;
+            };
+
+            bool OpenLoopback(QObject* owner, Transport& transport)
+            {
+                QTcpServer listener;
+                if (!listener.listen(QHostAddress::LocalHost, 0))
+                    return false;
+                QTcpSocket* client = new QTcpSocket(owner);
+                client->connectToHost(QHostAddress::LocalHost, listener.serverPort());
+                if (!client->waitForConnected(runTimeout) || !listener.waitForNewConnection(runTimeout))
+                    return false;
+                QTcpSocket* server = listener.nextPendingConnection();
+                server->setParent(owner);
+                //Small commands go at once as server's replies do
+                client->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+                server->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+                transport.client = client;
+                transport.server = server;
+                transport.close = [client, server]()
+                {
+                    client->close();
+                    server->close();
+                };
+                return true;
+            }
+
+            bool OpenSocketPair(QObject* owner, Transport& transport)
+            {
+#ifdef Q_OS_UNIX
+                int fds[2];
+                if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+                    return false;
+                QLocalSocket* client = new QLocalSocket(owner);
+                QLocalSocket* server = new QLocalSocket(owner);
+                client->setSocketDescriptor(fds[0]);
+                server->setSocketDescriptor(fds[1]);
+                transport.client = client;
+                transport.server = server;
+                transport.close = [client, server]()
+                {
+                    client->close();
+                    server->close();
+                };
+                return true;
+#else
+                Q_UNUSED(owner);
+                Q_UNUSED(transport);
+                return false;   //There is no socketpair(), stage is reported as failed
+#endif
+            }
+
+            //Client writes all commands at once, server side frames them as they come
+            qint64 RunFramingThroughTransport(const QByteArray& stream, int count, bool (*open)(QObject*, Transport&))
+            {
+                QObject owner;
+                Transport transport;
+                if (!open(&owner, transport))
+                    return -1;
+
+                QEventLoop loop;
+                quint16 nextBlockSize = 0;
+                int received = 0;
+                qint64 checksum = 0;
+                QObject::connect(transport.server, &QIODevice::readyRead, &loop, [&]()
+                {
+                    received += ReadFrames(transport.server, nextBlockSize, [&](const uchar*, quint16 size)
+                    {
+                        checksum += size;
+                    });
+                    if (received == count)
+                        loop.quit();
+                });
+
+                QElapsedTimer timer;
+                timer.start();
+                transport.client->write(stream);
+                bool ok = Exec(loop);
+                qint64 nsecs = timer.nsecsElapsed();
+                transport.close();
+                return ok && checksum ? nsecs : -1;
+            }
+
+            //Client sends next command only when server side echoed previous one back
+            qint64 RunRoundTripThroughTransport(int count, bool (*open)(QObject*, Transport&))
+            {
+                QObject owner;
+                Transport transport;
+                if (!open(&owner, transport))
+                    return -1;
+
+                QByteArray command;
+                TextProtocol::AppendMessage(command, QStringLiteral("3#1"));
+                QEventLoop loop;
+                quint16 serverBlockSize = 0, clientBlockSize = 0;
+                int answered = 0;
+                QObject::connect(transport.server, &QIODevice::readyRead, &loop, [&]()
+                {
+                    ReadFrames(transport.server, serverBlockSize, [&](const uchar*, quint16)
+                    {
+                        transport.server->write(command);
+                    });
+                });
+                QObject::connect(transport.client, &QIODevice::readyRead, &loop, [&]()
+                {
+                    answered += ReadFrames(transport.client, clientBlockSize, [&](const uchar*, quint16)
+                    {
+                        if (answered + 1 < count)
+                            transport.client->write(command);
+                    });
+                    if (answered == count)
+                        loop.quit();
+                });
+
+                QElapsedTimer timer;
+                timer.start();
+                transport.client->write(command);
+                bool ok = Exec(loop);
+                qint64 nsecs = timer.nsecsElapsed();
+                transport.close();
+                return ok ? nsecs : -1;
+            }
+
+            //Worker thread with sink, as AVR System lives in worker thread of device host
+            struct Worker
+            {
+                CommandQueue queue;
+                QThread thread;
+                StageSink* sink;
+                StageSource source;
+
+                Worker()
+                    : queue(streamCount)
+                {
+                    sink = new StageSink(&queue);
+                    sink->moveToThread(&thread);
+                    QObject::connect(&source, &StageSource::AVRMessage, sink, &StageSink::OnMessage);
+                    QObject::connect(&source, &StageSource::CommandsQueued, sink, &StageSink::OnCommandsQueued);
+                    thread.start();
+                }
+
+                ~Worker()
+                {
+                    thread.quit();
+                    thread.wait();
+                    delete sink;
+                }
+
+                void Expect(int count, bool echo)
+                {
+                    QMetaObject::invokeMethod(sink, "Expect", Qt::BlockingQueuedConnection,
+                                              Q_ARG(int, count), Q_ARG(bool, echo));
+                }
+
+                void Push(const Message& msg)   //The same as Server::DispatchMessage() does
+                {
+                    bool notify = false;
+                    queue.Push(msg, notify);
+                    if (notify)
+                        emit source.CommandsQueued();
+                }
+            };
+
+            //Reads replies of emulator's server and calls handle(reply) for every one of them
+            template<typename Handler>
+            int ReadReplies(QTcpSocket* socket, quint16& nextBlockSize, Handler handle)
+            {
+                return ReadFrames(socket, nextBlockSize, [&](const uchar* block, quint16 size)
+                {
+                    TextProtocol::MessageView view;
+                    TextProtocol::MessageView::FromBlock(block, size, view);
+                    handle(TextProtocol::ParseReply(view));
+                });
+            }
+
+            //Connection to emulator's server. It's opened once for all end-to-end stages,
+            //so every stage talks to AVR as its controller.
+            struct EndToEndClient
+            {
+                QTcpSocket socket;
+                quint16 nextBlockSize = 0;
+
+                bool Open(quint16 port)
+                {
+                    socket.connectToHost(QHostAddress::LocalHost, port);
+                    if (!socket.waitForConnected(runTimeout))
+                        return false;
+                    socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+                    QEventLoop loop;
+                    bool ready = false, observer = false;
+                    QObject::connect(&socket, &QIODevice::readyRead, &loop, [&]()
+                    {
+                        ReadReplies(&socket, nextBlockSize, [&](const TextProtocol::Reply& reply)
+                        {
+                            if (reply.token == 'o')
+                                observer = true;
+                            else if (reply.token == 'i')    //Server is ready for commands
+                            {
+                                ready = true;
+                                loop.quit();
+                            }
+                        });
+                    });
+                    QByteArray version;
+                    TextProtocol::AppendMessage(version, QStringLiteral("\\v1"));   //Request IDs are used
+                    socket.write(version);
+                    return Exec(loop) && ready && !observer;
+                }
+
+                //Sends commands and waits for final reply token of every one of them. If pipelined, all commands
+                //are sent at once, otherwise next one is sent when previous one is complete.
+                qint64 Run(int count, bool pipelined, char finalToken, const std::function<QString(int)>& command)
+                {
+                    QEventLoop loop;
+                    int complete = 0;
+                    auto send = [&](int index)
+                    {
+                        QByteArray block;
+                        TextProtocol::AppendMessage(block, command(index));
+                        socket.write(block);
+                    };
+                    QObject::connect(&socket, &QIODevice::readyRead, &loop, [&]()
+                    {
+                        ReadReplies(&socket, nextBlockSize, [&](const TextProtocol::Reply& reply)
+                        {
+                            if (reply.token != finalToken || !reply.requestId)
+                                return;
+                            if (++complete == count)
+                                loop.quit();
+                            else if (!pipelined)
+                                send(complete);
+                        });
+                    });
+                    QObject::connect(&socket, &QTcpSocket::disconnected, &loop, &QEventLoop::quit);
+
+                    QElapsedTimer timer;
+                    timer.start();
+                    if (pipelined)
+                    {
+                        QByteArray stream;
+                        for (int i = 0; i < count; i++)
+                            TextProtocol::AppendMessage(stream, command(i));
+                        socket.write(stream);
+                    }
+                    else
+                        send(0);
+                    bool ok = Exec(loop) && complete == count;
+                    return ok ? timer.nsecsElapsed() : -1;
+                }
+            };
+        }
+
+        StageSource::StageSource(QObject* parent)
+            : QObject(parent)
+        {
+        }
+
+        StageSink::StageSink(CommandQueue* queue, QObject* parent)
+            : QObject(parent)
+        {
+            m_pQueue = queue;
+            m_iExpected = 0;
+            m_iReceived = 0;
+            m_iChecksum = 0;
+            m_bEcho = false;
+        }
+
+        void StageSink::Expect(int count, bool echo)
+        {
+            m_iExpected = count;
+            m_iReceived = 0;
+            m_iChecksum = 0;
+            m_bEcho = echo;
+        }
+
+        void StageSink::Receive(const Message& msg)
+        {
+            if (m_bEcho)
+            {
+                emit SendPosition(msg.GetSteps(), msg.GetRequestId());
+                return;
+            }
+            m_iChecksum += msg.GetSteps();
+            if (++m_iReceived == m_iExpected)
+                emit Done(m_iChecksum);
+        }
+
+        void StageSink::OnMessage(AVR::Message msg)
+        {
+            Receive(msg);
+        }
+
+        void StageSink::OnCommandsQueued()
+        {
+            m_pQueue->StartTaking();    //The same as AVR System's DrainQueue() does
+            Message msg;
+            bool wasFull = false;
+            while (m_pQueue->TakeNext(msg, false, wasFull))
+                Receive(msg);
+        }
+
+        void StageSink::EmitReplies(int count)
+        {
+            for (int i = 0; i < count; i++)
+                emit SendPosition(i, quint32(i + 1));
+        }
+
+        void RunStageBenchmarks(int runs)
+        {
+            qRegisterMetaType<AVR::Message>("AVR::Message");
+            std::printf("Stages of command's life, median of %d runs\n\n", runs);
+
+            const QByteArray commands = MakeCommands(streamCount);
+
+            //1. Framing (Server::slotReadClient): in memory, and with transport under it
+            Stage("Framing, in memory", runs, streamCount, [&]()
+            {
+                QBuffer buffer;
+                buffer.setData(commands);
+                buffer.open(QIODevice::ReadOnly);
+                quint16 nextBlockSize = 0;
+                qint64 checksum = 0;
+                QElapsedTimer timer;
+                timer.start();
+                int received = ReadFrames(&buffer, nextBlockSize, [&](const uchar*, quint16 size)
+                {
+                    checksum += size;
+                });
+                qint64 nsecs = timer.nsecsElapsed();
+                return received == streamCount && checksum ? nsecs : -1;
+            });
+            Stage("Framing, loopback TCP", runs, streamCount, [&]()
+            {
+                return RunFramingThroughTransport(commands, streamCount, OpenLoopback);
+            });
+            Stage("Framing, socket pair", runs, streamCount, [&]()
+            {
+                return RunFramingThroughTransport(commands, streamCount, OpenSocketPair);
+            });
+
+            //2. Decoding (Server::FormMessage) of framed commands into AVR::Message
+            Stage("Decode to AVR::Message", runs, streamCount, [&]()
+            {
+                const uchar* data = reinterpret_cast<const uchar*>(commands.constData());
+                const uchar* end = data + commands.size();
+                qint64 checksum = 0;
+                QElapsedTimer timer;
+                timer.start();
+                while (data < end)
+                {
+                    quint16 blockSize = qFromBigEndian<quint16>(data);
+                    TextProtocol::MessageView view;
+                    TextProtocol::MessageView::FromBlock(data + 2, blockSize, view);
+                    TextProtocol::Command command = TextProtocol::ParseCommand(view);
+                    Message msg(Message::Type(command.code), command.steps, command.requestId);
+                    checksum += msg.GetSteps() + msg.GetRequestId();
+                    data += 2 + blockSize;
+                }
+                qint64 nsecs = timer.nsecsElapsed();
+                return checksum ? nsecs : -1;
+            });
+
+            //3. Hop to AVR System's thread: legacy AVRMessage signal copies every message through metatype system,
+            //command queue wakes AVR System once for all commands pushed before it started taking them
+            std::printf("\n");
+            Worker worker;
+            Stage("Hop to AVR thread, AVR::Message signal", runs, streamCount, [&]()
+            {
+                worker.Expect(streamCount, false);
+                QEventLoop loop;
+                QObject::connect(worker.sink, &StageSink::Done, &loop, &QEventLoop::quit);
+                QElapsedTimer timer;
+                timer.start();
+                for (int i = 0; i < streamCount; i++)
+                    emit worker.source.AVRMessage(Message(Message::Type::MoveForNSteps, 56, quint32(i + 1)));
+                bool ok = Exec(loop);
+                return ok ? timer.nsecsElapsed() : -1;
+            });
+            Stage("Hop to AVR thread, command queue", runs, streamCount, [&]()
+            {
+                worker.Expect(streamCount, false);
+                QEventLoop loop;
+                QObject::connect(worker.sink, &StageSink::Done, &loop, &QEventLoop::quit);
+                QElapsedTimer timer;
+                timer.start();
+                for (int i = 0; i < streamCount; i++)
+                    worker.Push(Message(Message::Type::MoveForNSteps, 56, quint32(i + 1)));
+                bool ok = Exec(loop);
+                return ok ? timer.nsecsElapsed() : -1;
+            });
+
+            //4. Reply back to server's thread (AVRSystem::SendPosition signal)
+            Stage("Reply to server thread, SendPosition", runs, streamCount, [&]()
+            {
+                QEventLoop loop;
+                int received = 0;
+                QObject::connect(worker.sink, &StageSink::SendPosition, &loop, [&](int, quint32)
+                {
+                    if (++received == streamCount)
+                        loop.quit();
+                });
+                QElapsedTimer timer;
+                timer.start();
+                QMetaObject::invokeMethod(worker.sink, "EmitReplies", Qt::QueuedConnection, Q_ARG(int, streamCount));
+                bool ok = Exec(loop);
+                return ok ? timer.nsecsElapsed() : -1;
+            });
+
+            //Hop and reply together, one command at a time: latency of two event loop wake-ups
+            Stage("Round trip, AVR::Message signal", runs, roundTrips, [&]()
+            {
+                worker.Expect(0, true);
+                QEventLoop loop;
+                int answered = 0;
+                QObject::connect(worker.sink, &StageSink::SendPosition, &loop, [&](int, quint32)
+                {
+                    if (++answered == roundTrips)
+                        loop.quit();
+                    else
+                        emit worker.source.AVRMessage(Message(Message::Type::GetPosition, 0, quint32(answered + 1)));
+                });
+                QElapsedTimer timer;
+                timer.start();
+                emit worker.source.AVRMessage(Message(Message::Type::GetPosition, 0, 1));
+                bool ok = Exec(loop);
+                return ok ? timer.nsecsElapsed() : -1;
+            });
+            Stage("Round trip, command queue", runs, roundTrips, [&]()
+            {
+                worker.Expect(0, true);
+                QEventLoop loop;
+                int answered = 0;
+                QObject::connect(worker.sink, &StageSink::SendPosition, &loop, [&](int, quint32)
+                {
+                    if (++answered == roundTrips)
+                        loop.quit();
+                    else
+                        worker.Push(Message(Message::Type::GetPosition, 0, quint32(answered + 1)));
+                });
+                QElapsedTimer timer;
+                timer.start();
+                worker.Push(Message(Message::Type::GetPosition, 0, 1));
+                bool ok = Exec(loop);
+                return ok ? timer.nsecsElapsed() : -1;
+            });
+
+            //5. Encoding of reply into session's output buffer (Server::sendToClient and sendRecord)
+            std::printf("\n");
+            Stage("Reply encode, text", runs, streamCount, [&]()
+            {
+                QByteArray output;
+                qint64 written = 0;
+                QElapsedTimer timer;
+                timer.start();
+                for (int i = 0; i < streamCount; i++)
+                {
+                    if (output.size() > 64 * 1024)  //Flushed to socket
+                    {
+                        written += output.size();
+                        output.clear();
+                    }
+                    QString msg;
+                    msg.sprintf("\\p%i", i % 15000);    //As Server::SendPosition() forms it
+                    msg += QStringLiteral("#%1").arg(i + 1);
+                    TextProtocol::AppendMessage(output, msg);
+                }
+                qint64 nsecs = timer.nsecsElapsed();
+                return written + output.size() ? nsecs : -1;
+            });
+            Stage("Reply encode, binary", runs, streamCount, [&]()
+            {
+                QByteArray output;
+                qint64 written = 0;
+                QElapsedTimer timer;
+                timer.start();
+                for (int i = 0; i < streamCount; i++)
+                {
+                    if (output.size() > 64 * 1024)
+                    {
+                        written += output.size();
+                        output.clear();
+                    }
+                    int offset = output.size();
+                    output.resize(offset + Protocol::RecordSize);
+                    Protocol::Encode({Protocol::Opcode::Position, 0, i % 15000, 0, quint32(i + 1)},
+                                     reinterpret_cast<uchar*>(output.data()) + offset);
+                }
+                qint64 nsecs = timer.nsecsElapsed();
+                return written + output.size() ? nsecs : -1;
+            });
+
+            //Transport latency alone: one message each way
+            std::printf("\n");
+            Stage("Round trip, loopback TCP", runs, roundTrips, [&]()
+            {
+                return RunRoundTripThroughTransport(roundTrips, OpenLoopback);
+            });
+            Stage("Round trip, socket pair", runs, roundTrips, [&]()
+            {
+                return RunRoundTripThroughTransport(roundTrips, OpenSocketPair);
+            });
+
+            //Whole path through real server and AVR System. Moves are complete instantly by virtual clock.
+            std::printf("\n");
+            quint16 port = 0;
+            {
+                QTcpServer probe;   //Free port for emulator
+                if (probe.listen(QHostAddress::LocalHost, 0))
+                    port = probe.serverPort();
+            }
+            Settings settings;
+            settings.host = QHostAddress::LocalHost;
+            settings.port = port;
+            settings.clock = Clock(Clock::Mode::Virtual);
+            settings.queueDepth = 1024;
+            DeviceHost host;
+            try
+            {
+                host.Start(settings);
+            }
+            catch(const std::exception& e)
+            {
+                std::printf("End-to-end stages are skipped: %s\n", e.what());
+                return;
+            }
+            auto position = [](int index)
+            {
+                return QStringLiteral("3#%1").arg(index + 1);
+            };
+            auto move = [](int index)   //Moves between two positions, so AVR never leaves range
+            {
+                return QStringLiteral("8:%1#%2").arg(index % 2 ? 100 : 200).arg(index + 1);
+            };
+            EndToEndClient client;
+            if (!client.Open(port))
+            {
+                std::printf("End-to-end stages are skipped: emulator didn't accept connection as controller\n");
+                return;
+            }
+            Stage("End-to-end position request, round trip", runs, roundTrips, [&]()
+            {
+                return client.Run(roundTrips, false, 'p', position);
+            });
+            Stage("End-to-end position request, pipelined", runs, streamCount, [&]()
+            {
+                return client.Run(streamCount, true, 'p', position);
+            });
+            Stage("End-to-end move order, round trip", runs, roundTrips, [&]()
+            {
+                return client.Run(roundTrips, false, 's', move);
+            });
+            Stage("End-to-end move order, pipelined", runs, streamCount, [&]()
+            {
+                return client.Run(streamCount, true, 's', move);
+            });
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QObject>
+#include "avrmessage.h"
+#include "avrcommandqueue.h"
+
+namespace AVR
+{
+    namespace Bench
+    {
+        //Receiver of commands in worker thread, it stands for AVR System. It counts commands which came
+        //by queued signal or by command queue, or answers every command at once as AVR System answers position request.
+        class StageSink : public QObject
+        {
+            Q_OBJECT
+
+        private:
+            CommandQueue* m_pQueue;     //Queue of current path, owned by benchmark
+            int m_iExpected;            //Commands to receive before Done
+            int m_iReceived;
+            qint64 m_iChecksum;         //Keeps compiler from skipping work
+            bool m_bEcho;               //Answer every command by SendPosition instead of counting
+
+            void Receive(const Message& msg);
+
+        public:
+            StageSink(CommandQueue* queue, QObject* parent = 0);
+
+        public slots:
+            void Expect(int count, bool echo);  //Starts new run. Called by blocking queued connection.
+            void OnMessage(AVR::Message msg);   //Legacy path: every command is copied through Qt metatype system
+            void OnCommandsQueued();            //Current path: commands wait in queue, signal only wakes sink up
+            void EmitReplies(int count);        //Sends count replies back by SendPosition
+
+        signals:
+            void Done(qint64 checksum);
+            void SendPosition(int pos, quint32 requestId);  //Same signature as AVR System's reply
+        };
+
+        //Sender of commands in main thread, it stands for server. Signals are the same as server's.
+        class StageSource : public QObject
+        {
+            Q_OBJECT
+
+        public:
+            StageSource(QObject* parent = 0);
+
+        signals:
+            void AVRMessage(AVR::Message msg);
+            void CommandsQueued();
+        };
+
+        //Runs benchmarks of every stage of command's life and end-to-end ones through emulator core.
+        //Every stage is measured runs times and median is reported.
+        void RunStageBenchmarks(int runs);
+    }
+}
@@ -0,0 +1,32 @@
+#-------------------------------------------------
+#
+# Protocol checks of AVR emulator. Console application, runs emulator
+# core in process and talks to its server over loopback TCP,
+# by raw records and by AVR client library.
+# Exit code is 1 if any check failed.
+#
+#-------------------------------------------------
+
+QT       -= gui
+
+TARGET = AVR_Check
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../AVR_Emulator/avrcore.pri)
+include(../AVR_Client/avrclient.pri)
+
+SOURCES += \
+        main.cpp \
+    protocolcheck.cpp
+
+HEADERS += \
+    protocolcheck.h
+
+DESTDIR = ../bin/check
+OBJECTS_DIR = ../bin/check/.obj
+MOC_DIR = ../bin/check/.moc
+RCC_DIR = ../bin/check/.rcc
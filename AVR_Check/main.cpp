@@ -0,0 +1,10 @@
+#include <QCoreApplication>
+#include "protocolcheck.h"
+
+//Protocol checks of AVR emulator. They run real emulator core in this process and fail by exit code,
+//so they can be run alone or by build script after every change of protocol code.
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    return AVR::Check::RunProtocolChecks() ? 0 : 1;
+}
@@ -0,0 +1,310 @@
+#include "protocolcheck.h"
+#include "avrhost.h"
+#include "avrsettings.h"
+#include "avrprotocol.h"
+#include "avrtextprotocol.h"
+#include "avrasyncclient.h"
+#include <QEventLoop>
+#include <QTimer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QVector>
+#include <functional>
+#include <stdexcept>
+#include <cstdio>
+
+namespace AVR
+{
+    namespace Check
+    {
+        namespace
+        {
+            const int checkTimeout = 10000;     //Milliseconds. Reply which doesn't come in time fails the check.
+
+            //Binary connection to emulator's server. It keeps every record server sent, so checks can look for replies.
+            struct BinaryClient
+            {
+                QTcpSocket socket;
+                quint16 nextBlockSize = 0;
+                bool initialized = false;   //Text \i came
+                bool observer = false;
+                bool binary = false;        //Server confirmed binary protocol, next data are records
+                quint16 device = 0;
+                QVector<Protocol::Record> replies;
+
+                //Reads text messages until server switches to binary protocol, records after it
+                void Read()
+                {
+                    while (true)
+                    {
+                        if (binary)
+                        {
+                            uchar record[Protocol::RecordSize];
+                            if (socket.bytesAvailable() < Protocol::RecordSize)
+                                return;
+                            socket.read(reinterpret_cast<char*>(record), Protocol::RecordSize);
+                            replies.append(Protocol::Decode(record));
+                            continue;
+                        }
+                        if (!nextBlockSize)
+                        {
+                            uchar size[sizeof(quint16)];
+                            if (socket.bytesAvailable() < qint64(sizeof(quint16)))
+                                return;
+                            socket.read(reinterpret_cast<char*>(size), sizeof(quint16));
+                            nextBlockSize = qFromBigEndian<quint16>(size);
+                        }
+                        if (socket.bytesAvailable() < nextBlockSize)
+                            return;
+                        QByteArray block = socket.read(nextBlockSize);
+                        nextBlockSize = 0;
+                        TextProtocol::MessageView view;
+                        TextProtocol::MessageView::FromBlock(reinterpret_cast<const uchar*>(block.constData()), block.size(), view);
+                        TextProtocol::Reply reply = TextProtocol::ParseReply(view);
+                        if (reply.token == 'i')
+                            initialized = true;
+                        else if (reply.token == 'o')
+                            observer = true;
+                        else if (reply.token == 'v' && reply.arg0 == Protocol::BinaryVersion)
+                        {
+                            device = quint16(reply.arg1);
+                            binary = true;
+                        }
+                    }
+                }
+
+                //Runs event loop until done() is true, returns false if it timed out or server disconnected
+                bool WaitFor(const std::function<bool()>& done)
+                {
+                    Read();
+                    if (done())
+                        return true;
+                    QEventLoop loop;
+                    QObject::connect(&socket, &QIODevice::readyRead, &loop, [&]()
+                    {
+                        Read();
+                        if (done())
+                            loop.quit();
+                    });
+                    QObject::connect(&socket, &QTcpSocket::disconnected, &loop, &QEventLoop::quit);
+                    QTimer::singleShot(checkTimeout, &loop, &QEventLoop::quit);
+                    loop.exec();
+                    return done();
+                }
+
+                //Connects as controller and switches to binary protocol after client is initialized
+                bool Open(quint16 port)
+                {
+                    socket.connectToHost(QHostAddress::LocalHost, port);
+                    if (!socket.waitForConnected(checkTimeout))
+                        return false;
+                    socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+                    if (!WaitFor([&]() { return initialized; }) || observer)
+                        return false;
+                    QByteArray version;
+                    TextProtocol::AppendMessage(version, QStringLiteral("\\v%1").arg(Protocol::BinaryVersion));
+                    socket.write(version);
+                    return WaitFor([&]() { return binary; });
+                }
+
+                //Writes all records at once, so server reads them by one socket read
+                void Send(const QVector<Protocol::Record>& records)
+                {
+                    QByteArray data(records.size() * Protocol::RecordSize, 0);
+                    for (int i = 0; i < records.size(); i++)
+                        Protocol::Encode(records[i], reinterpret_cast<uchar*>(data.data()) + i * Protocol::RecordSize);
+                    socket.write(data);
+                    socket.flush();
+                }
+
+                const Protocol::Record* Find(Protocol::Opcode opcode, quint32 requestId) const
+                {
+                    for (const Protocol::Record& record : replies)
+                    {
+                        if (record.opcode == opcode && record.requestId == requestId)
+                            return &record;
+                    }
+                    return nullptr;
+                }
+
+                int Count(Protocol::Opcode opcode, quint32 requestId) const
+                {
+                    int count = 0;
+                    for (const Protocol::Record& record : replies)
+                    {
+                        if (record.opcode == opcode && record.requestId == requestId)
+                            count++;
+                    }
+                    return count;
+                }
+
+                bool HasError(quint32 requestId, Protocol::ErrorCode code) const
+                {
+                    const Protocol::Record* error = Find(Protocol::Opcode::Error, requestId);
+                    return error && error->arg0 == qint32(code);
+                }
+            };
+
+            //Starts emulator with one device on free localhost port
+            bool StartHost(DeviceHost& host, quint16& port)
+            {
+                {
+                    QTcpServer probe;   //Free port for emulator
+                    if (probe.listen(QHostAddress::LocalHost, 0))
+                        port = probe.serverPort();
+                }
+                Settings settings;
+                settings.host = QHostAddress::LocalHost;
+                settings.port = port;
+                settings.chanceToLie = 0;   //Waypoints are compared with reached positions
+                settings.clock = Clock(Clock::Mode::Virtual);
+                try
+                {
+                    host.Start(settings);
+                }
+                catch(const std::exception& e)
+                {
+                    std::printf("Emulator FAILED to start: %s\n", e.what());
+                    return false;
+                }
+                return true;
+            }
+
+            void Report(const char* name, bool passed)
+            {
+                std::printf("%-46s %s\n", name, passed ? "passed" : "FAILED");
+            }
+
+            //Checks of server by raw binary records
+            bool RunRecordChecks()
+            {
+                quint16 port = 0;
+                DeviceHost host;
+                if (!StartHost(host, port))
+                    return false;
+                BinaryClient client;
+                if (!client.Open(port))
+                {
+                    std::printf("Record checks FAILED: emulator didn't accept binary connection as controller\n");
+                    return false;
+                }
+                const quint16 device = client.device;
+                bool passed = true;
+
+                //1. Header and waypoints come by different reads. Replies to pipelined move are flushed between them.
+                const QVector<int> waypoints = {300, 50, 700};
+                client.Send({{Protocol::Opcode::MoveTo, device, 100, 0, 10},
+                             {Protocol::Opcode::Trajectory, device, waypoints.size(), 0, 11}});
+                bool ok = client.WaitFor([&]() { return client.Find(Protocol::Opcode::Success, 10) != nullptr; });
+                client.Send({{Protocol::Opcode::TrajectoryPoints, device, waypoints[0], waypoints[1], 11},
+                             {Protocol::Opcode::TrajectoryPoints, device, waypoints[2], 0, 11}});
+                ok = ok && client.WaitFor([&]()
+                {
+                    return client.Find(Protocol::Opcode::Success, 11) || client.Find(Protocol::Opcode::Error, 11);
+                });
+                QVector<int> reached;
+                for (const Protocol::Record& record : client.replies)
+                {
+                    if (record.opcode == Protocol::Opcode::WaypointReached && record.requestId == 11 && record.arg0 == reached.size())
+                        reached.append(record.arg1);
+                }
+                ok = ok && client.Find(Protocol::Opcode::Success, 11) && !client.Find(Protocol::Opcode::Error, 11) && reached == waypoints;
+                Report("Trajectory split across reads", ok);
+                passed = passed && ok;
+
+                //2. Another record comes before all waypoints: trajectory is rejected, the record is handled as usual
+                client.Send({{Protocol::Opcode::Trajectory, device, 3, 0, 21},
+                             {Protocol::Opcode::GetPosition, device, 0, 0, 22}});
+                ok = client.WaitFor([&]()
+                {
+                    return client.Find(Protocol::Opcode::Error, 21) && client.Find(Protocol::Opcode::Position, 22);
+                });
+                ok = ok && client.HasError(21, Protocol::ErrorCode::WrongTrajectory);
+                Report("Trajectory broken by another record", ok);
+                passed = passed && ok;
+
+                //3. Waypoints of broken trajectory which come after the record that broke it are dropped silently
+                client.Send({{Protocol::Opcode::TrajectoryPoints, device, 1, 2, 21},
+                             {Protocol::Opcode::TrajectoryPoints, device, 3, 0, 21},
+                             {Protocol::Opcode::GetPosition, device, 0, 0, 24}});
+                ok = client.WaitFor([&]() { return client.Find(Protocol::Opcode::Position, 24) != nullptr; });
+                ok = ok && client.Count(Protocol::Opcode::Error, 21) == 1;
+                Report("Rest of broken trajectory", ok);
+                passed = passed && ok;
+
+                //4. Too long trajectory is rejected once, all its waypoints are dropped
+                const int tooMany = Protocol::MaxWaypoints + 1;
+                QVector<Protocol::Record> rejected = {{Protocol::Opcode::Trajectory, device, tooMany, 0, 31}};
+                for (int i = 0; i < tooMany; i += 2)
+                    rejected.append({Protocol::Opcode::TrajectoryPoints, device, i, i + 1, 31});
+                rejected.append({Protocol::Opcode::GetPosition, device, 0, 0, 32});
+                client.Send(rejected);
+                ok = client.WaitFor([&]() { return client.Find(Protocol::Opcode::Position, 32) != nullptr; });
+                ok = ok && client.HasError(31, Protocol::ErrorCode::WrongTrajectory) && client.Count(Protocol::Opcode::Error, 31) == 1;
+                Report("Too long trajectory", ok);
+                passed = passed && ok;
+
+                //5. Waypoints which no trajectory accounts for are rejected
+                client.Send({{Protocol::Opcode::TrajectoryPoints, device, 1, 2, 23}});
+                ok = client.WaitFor([&]() { return client.Find(Protocol::Opcode::Error, 23) != nullptr; });
+                ok = ok && client.HasError(23, Protocol::ErrorCode::WrongTrajectory);
+                Report("Waypoints without trajectory", ok);
+                passed = passed && ok;
+
+                return passed;
+            }
+
+            //Client sends orders right from Ready signal, as AVR_LoadGen does. They must go by protocol server has chosen.
+            bool RunClientCheck(bool binary)
+            {
+                quint16 port = 0;
+                DeviceHost host;   //Own emulator, so client is controller
+                if (!StartHost(host, port))
+                    return false;
+
+                const QVector<int> waypoints = {300, 50, 700};
+                QVector<int> reached;
+                bool ok = false;
+                AsyncClient client;
+                QEventLoop loop;
+                QObject::connect(&client, &AsyncClient::Ready, &loop, [&](int, int)
+                {
+                    if (client.IsBinary() != binary || !client.HasRequestIds())
+                    {
+                        loop.quit();
+                        return;
+                    }
+                    client.MoveTo(100);
+                    client.FollowTrajectory(waypoints, [&](const RequestResult& result)
+                    {
+                        ok = result.IsOk() && reached == waypoints;
+                        loop.quit();
+                    },
+                    [&](int, int pos)
+                    {
+                        reached.append(pos);
+                    });
+                });
+                QObject::connect(&client, &AsyncClient::Disconnected, &loop, &QEventLoop::quit);
+                QTimer::singleShot(checkTimeout, &loop, &QEventLoop::quit);
+                client.Connect(QHostAddress(QHostAddress::LocalHost).toString(), port, binary);
+                loop.exec();
+                return ok;
+            }
+        }
+
+        bool RunProtocolChecks()
+        {
+            std::printf("Protocol checks\n\n");
+            bool passed = RunRecordChecks();
+            bool ok = RunClientCheck(true);
+            Report("Client orders from Ready, binary", ok);
+            passed = passed && ok;
+            ok = RunClientCheck(false);
+            Report("Client orders from Ready, text", ok);
+            passed = passed && ok;
+            std::printf("\n");
+            return passed;
+        }
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace AVR
+{
+    namespace Check
+    {
+        //Checks binary trajectory assembly of real server: trajectory split across socket
+        //reads with server's output flushed between them, trajectory broken by another record, too long trajectory,
+        //and waypoints without trajectory. Then checks that AsyncClient's orders sent right from Ready signal are
+        //handled by both protocols. Prints result of every check. Returns false if any of them failed.
+        bool RunProtocolChecks();
+    }
+}
@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# AVR client library. Asynchronous AVR protocol client without
+# QtWidgets, shared by AVR Testing and automation tools.
+# Applications link it by including avrclient.pri.
+#
+#-------------------------------------------------
+
+QT       -= gui
+QT       += network
+
+TARGET = avrclient
+TEMPLATE = lib
+CONFIG += staticlib
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += ../Common
+
+SOURCES += \
+        avrasyncclient.cpp
+
+HEADERS += \
+    avrasyncclient.h \
+    ../Common/avrprotocol.h \
+    ../Common/avrtextprotocol.h
+
+DESTDIR = ../bin/lib
+OBJECTS_DIR = ../bin/lib/.obj
+MOC_DIR = ../bin/lib/.moc
+RCC_DIR = ../bin/lib/.rcc
@@ -0,0 +1,642 @@
+#include "avrasyncclient.h"
+#include <QTimer>
+
+namespace AVR
+{
+    namespace
+    {
+        const QString errorPrefix = QString::fromLatin1(TextProtocol::ErrorPrefix);   //Text protocol errors start with it
+
+        //Filters of requests which could get reply without request ID
+        bool AnyRequest(MessageType)
+        {
+            return true;
+        }
+
+        bool IsPositionRequest(MessageType type)
+        {
+            return type == MessageType::GetPosition;
+        }
+
+        bool IsMove(MessageType type)   //Orders which move AVR. Their move could be halted.
+        {
+            return type == MessageType::MoveForNSteps || type == MessageType::MoveToZero || type == MessageType::MoveTo ||
+                   type == MessageType::Trajectory || type == MessageType::Retarget;
+        }
+
+        bool IsSuccessful(MessageType type) //Orders which end with success message. Stop gets it when AVR is stopped.
+        {
+            return IsMove(type) || type == MessageType::Stop;
+        }
+
+        bool IsTrajectory(MessageType type)
+        {
+            return type == MessageType::Trajectory;
+        }
+
+        bool IsSubscribe(MessageType type)
+        {
+            return type == MessageType::Subscribe;
+        }
+
+        bool IsUnsubscribe(MessageType type)
+        {
+            return type == MessageType::Unsubscribe;
+        }
+    }
+
+    AsyncClient::AsyncClient(QObject* parent /*=0*/)
+        : QObject(parent),
+          m_nNextBlockSize(0)
+    {
+        m_pTcpSocket = nullptr;
+        m_bConnected = false;
+        m_bReady = false;
+        m_bInitialized = false;
+        m_iInitPos = 0;
+        m_bProtocolChosen = false;
+        m_iMaxPos = 0;
+        m_bUseBinary = false;
+        m_bBinary = false;
+        m_iDeviceId = 0;
+        m_bRequestIds = false;
+        m_bObserver = false;
+        m_iLastRequestId = 0;
+    }
+
+    AsyncClient::~AsyncClient()
+    {
+        //Owners of callbacks may be destroyed already, so they are dropped without calls
+        m_Requests.clear();
+        m_Unnumbered.clear();
+        Disconnect();
+    }
+
+    void AsyncClient::Connect(const QString& strHost, int nPort, bool binaryProtocol) //Connects client to AVR host
+    {
+        if (m_bConnected)
+            Disconnect();   //Interrupt and clean-up current connection if it exists before creating new.
+
+        m_bUseBinary = binaryProtocol;
+        m_pTcpSocket = new QTcpSocket(this);    //Creating new socket
+        m_bConnected = true;    //Changing connected state to true
+        m_pTcpSocket->connectToHost(strHost, nPort);    //Connecting new socket to host
+
+        //Connecting socket's signals with client's slots (connected, ready to read and error occurred signals)
+        QObject::connect(m_pTcpSocket, &QTcpSocket::connected, this, &AsyncClient::slotConnected);
+        QObject::connect(m_pTcpSocket, &QTcpSocket::readyRead, this, &AsyncClient::slotReadyRead);
+        QObject::connect(m_pTcpSocket,
+            static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error),
+            this, &AsyncClient::slotError);
+    }
+
+    void AsyncClient::Disconnect()    //Disconnect from host and clean-up client data
+    {
+        if (!m_bConnected)   //Do not clean-up if disconnected already
+            return;
+
+        m_pTcpSocket->close();  //Closing socket
+        m_pTcpSocket->deleteLater();    //Asking him for self-delete
+        //Nulling client data
+        m_pTcpSocket = nullptr;
+        m_nNextBlockSize = 0;
+        m_bConnected = false;
+        m_bReady = false;
+        m_bInitialized = false;
+        m_iInitPos = 0;
+        m_bProtocolChosen = false;
+        m_iMaxPos = 0;
+        m_bBinary = false;
+        m_iDeviceId = 0;
+        m_bRequestIds = false;
+        m_bObserver = false;
+
+        //Replies to requests in flight will never come. Callbacks may send new orders, so lists are taken first.
+        QHash<quint32, Request> requests;
+        QList<Request> unnumbered;
+        requests.swap(m_Requests);
+        unnumbered.swap(m_Unnumbered);
+        RequestResult result;
+        result.status = RequestStatus::Disconnected;
+        for (auto it = requests.begin(); it != requests.end(); ++it)
+            if (it.value().done)
+                it.value().done(result);
+        for (const Request& request : unnumbered)
+            if (request.done)
+                request.done(result);
+        emit Disconnected();
+    }
+
+    bool AsyncClient::IsConnected() const
+    {
+        return m_bConnected;
+    }
+
+    bool AsyncClient::IsReady() const
+    {
+        return m_bReady;
+    }
+
+    bool AsyncClient::IsBinary() const
+    {
+        return m_bBinary;
+    }
+
+    bool AsyncClient::HasRequestIds() const
+    {
+        return m_bRequestIds;
+    }
+
+    bool AsyncClient::IsObserver() const
+    {
+        return m_bObserver;
+    }
+
+    int AsyncClient::GetMaxPosition() const
+    {
+        return m_iMaxPos;
+    }
+
+    int AsyncClient::GetRequestsInFlight() const
+    {
+        return m_Requests.size() + m_Unnumbered.size();
+    }
+
+    quint32 AsyncClient::MoveBy(int steps, const ResultCallback& done)
+    {
+        return Send(MessageType::MoveForNSteps, steps, done);
+    }
+
+    quint32 AsyncClient::MoveToZero(const ResultCallback& done)
+    {
+        return Send(MessageType::MoveToZero, 0, done);
+    }
+
+    quint32 AsyncClient::MoveTo(int pos, const ResultCallback& done)
+    {
+        return Send(MessageType::MoveTo, pos, done);
+    }
+
+    quint32 AsyncClient::GetPosition(const ResultCallback& done)
+    {
+        return Send(MessageType::GetPosition, 0, done);
+    }
+
+    quint32 AsyncClient::Stop(const ResultCallback& done)
+    {
+        return Send(MessageType::Stop, 0, done);
+    }
+
+    quint32 AsyncClient::Retarget(int pos, const ResultCallback& done)
+    {
+        return Send(MessageType::Retarget, pos, done);
+    }
+
+    quint32 AsyncClient::Subscribe(int interval, const ResultCallback& done)
+    {
+        return Send(MessageType::Subscribe, interval, done);
+    }
+
+    quint32 AsyncClient::Unsubscribe(const ResultCallback& done)
+    {
+        return Send(MessageType::Unsubscribe, 0, done);
+    }
+
+    quint32 AsyncClient::Send(MessageType msg, int steps, const ResultCallback& done)   //Sends message to AVR host
+    {
+        if (FailIfNotReady(done))
+            return 0;
+        quint32 requestId = AddRequest(msg, done, WaypointCallback());
+
+        if (m_bBinary)  //Binary record is encoded in stack buffer and copied straight to socket's write buffer
+        {
+            uchar block[Protocol::RecordSize];
+            Protocol::Encode({Protocol::Opcode(msg), m_iDeviceId, steps, 0, requestId}, block);
+            m_pTcpSocket->write(reinterpret_cast<const char*>(block), Protocol::RecordSize);
+            return requestId;
+        }
+
+        QString FullMessage;
+        //Write step quantity into message string if going to send MoveForNSteps message, update interval or new goal
+        if (msg == MessageType::MoveForNSteps || msg == MessageType::Subscribe || msg == MessageType::Retarget ||
+            msg == MessageType::MoveTo)
+            FullMessage.sprintf("%i:%i", int(msg), steps);
+        else
+            FullMessage.sprintf("%i", int(msg));   //Otherwise just write the message code.
+        if (requestId)
+            FullMessage += QStringLiteral("#%1").arg(requestId);   //Request ID goes at the end of message
+        sendText(FullMessage);
+        return requestId;
+    }
+
+    quint32 AsyncClient::FollowTrajectory(const QVector<int>& waypoints, const ResultCallback& done,
+                                          const WaypointCallback& waypoint)
+    {
+        if (FailIfNotReady(done))
+            return 0;
+        quint32 requestId = AddRequest(MessageType::Trajectory, done, waypoint);
+
+        if (m_bBinary)  //Header record with waypoint count, than two waypoints per record. All of them go by one write.
+        {
+            int count = waypoints.size();
+            QByteArray data((1 + (count + 1) / 2) * Protocol::RecordSize, Qt::Uninitialized);
+            uchar* out = reinterpret_cast<uchar*>(data.data());
+            Protocol::Encode({Protocol::Opcode::Trajectory, m_iDeviceId, count, 0, requestId}, out);
+            for (int i = 0; i < count; i += 2)
+            {
+                out += Protocol::RecordSize;
+                Protocol::Encode({Protocol::Opcode::TrajectoryPoints, m_iDeviceId, waypoints[i],
+                                  i + 1 < count ? waypoints[i + 1] : 0, requestId}, out);
+            }
+            m_pTcpSocket->write(data);
+            return requestId;
+        }
+
+        QString FullMessage = QStringLiteral("%1:").arg(int(MessageType::Trajectory));
+        for (int i = 0; i < waypoints.size(); i++)
+        {
+            if (i)
+                FullMessage += ',';
+            FullMessage += QString::number(waypoints[i]);
+        }
+        if (requestId)
+            FullMessage += QStringLiteral("#%1").arg(requestId);
+        sendText(FullMessage);
+        return requestId;
+    }
+
+    bool AsyncClient::QueryMetrics()
+    {
+        if (!m_bReady || m_bBinary)     //Binary records can't carry report text
+            return false;
+        sendText("\\q");
+        return true;
+    }
+
+    bool AsyncClient::FailIfNotReady(const ResultCallback& done)
+    {
+        if (m_bReady)
+            return false;
+        if (done)   //Callback is never called from inside of order method, caller may be not ready for it
+        {
+            QTimer::singleShot(0, this, [done]()
+            {
+                RequestResult result;
+                result.status = RequestStatus::Disconnected;
+                done(result);
+            });
+        }
+        return true;
+    }
+
+    quint32 AsyncClient::NextRequestId()
+    {
+        if (!m_bRequestIds)
+            return 0;
+        if (++m_iLastRequestId == 0)    //0 means no ID, skipping it on overflow
+            ++m_iLastRequestId;
+        return m_iLastRequestId;
+    }
+
+    quint32 AsyncClient::AddRequest(MessageType type, const ResultCallback& done, const WaypointCallback& waypoint)
+    {
+        quint32 requestId = NextRequestId();
+        if (requestId)
+            m_Requests.insert(requestId, Request{type, done, waypoint});  //Replies will be matched with request by this ID
+        else
+            m_Unnumbered.append(Request{type, done, waypoint});
+        return requestId;
+    }
+
+    AsyncClient::Request* AsyncClient::FindRequest(quint32 requestId, bool (*filter)(MessageType))
+    {
+        if (requestId)
+        {
+            auto it = m_Requests.find(requestId);
+            return it != m_Requests.end() && filter(it.value().type) ? &it.value() : nullptr;
+        }
+        for (Request& request : m_Unnumbered)
+            if (filter(request.type))
+                return &request;
+        return nullptr;
+    }
+
+    void AsyncClient::CompleteRequest(quint32 requestId, bool (*filter)(MessageType), const RequestResult& result)
+    {
+        Request request;
+        if (requestId)
+        {
+            auto it = m_Requests.find(requestId);
+            if (it == m_Requests.end() || !filter(it.value().type))
+                return;
+            request = it.value();
+            m_Requests.erase(it);
+        }
+        else
+        {
+            int i = 0;
+            while (i < m_Unnumbered.size() && !filter(m_Unnumbered[i].type))
+                i++;
+            if (i == m_Unnumbered.size())
+                return;
+            request = m_Unnumbered.takeAt(i);
+        }
+        if (request.done)
+            request.done(result);
+        emit RequestComplete(requestId);
+    }
+
+    void AsyncClient::sendText(const QString& FullMessage)  //Sends text protocol message to AVR host
+    {
+        QByteArray arrBlock;
+        TextProtocol::AppendMessage(arrBlock, FullMessage);  //Encode our message to byte array block
+        m_pTcpSocket->write(arrBlock);  //Write prepared data to socket
+    }
+
+    void AsyncClient::slotConnected()    //When socket connected
+    {
+        emit Connected();
+        //Asking server for protocol version. Server which answers with device ID supports request IDs too.
+        if (m_bUseBinary)
+            sendText("\\v2");  //Asking server for binary protocol
+        else
+            sendText("\\v1");
+    }
+
+    void AsyncClient::slotError(QAbstractSocket::SocketError err)    //When socket error occurred
+    {
+        if (!m_pTcpSocket)  //Socket which is already closed
+            return;
+        emit SocketError(err, m_pTcpSocket->errorString());
+        Disconnect();   //Close connection and finish requests in flight. Does nothing if it was closed by signal.
+    }
+
+    void AsyncClient::slotReadyRead()    //This slot triggers by QTcpSocket::readyRead signal. Processes all incoming messages.
+    {
+        uchar block[TextProtocol::MaxBlockSize];    //Incoming messages are parsed right in this buffer
+        while(m_pTcpSocket) //Reading incoming data in loop. Handlers may close connection.
+        {
+            if (m_bBinary)  //Binary protocol: fixed-size records, decoded right from stack buffer
+            {
+                uchar record[Protocol::RecordSize];
+                if (m_pTcpSocket->bytesAvailable() < Protocol::RecordSize)
+                    break;
+                m_pTcpSocket->read(reinterpret_cast<char*>(record), Protocol::RecordSize);
+                HandleServerRecord(Protocol::Decode(record));
+                continue;
+            }
+
+            if (!m_nNextBlockSize)  //Break if no data to read
+            {
+                if (m_pTcpSocket->bytesAvailable() < qint64(sizeof(quint16)))
+                    break;
+                m_pTcpSocket->read(reinterpret_cast<char*>(block), sizeof(quint16));
+                m_nNextBlockSize = qFromBigEndian<quint16>(block);
+            }
+            if (m_pTcpSocket->bytesAvailable() < m_nNextBlockSize)
+                break;
+
+            TextProtocol::MessageView message;  //View of received string
+            if (m_nNextBlockSize <= TextProtocol::MaxBlockSize)
+            {
+                m_pTcpSocket->read(reinterpret_cast<char*>(block), m_nNextBlockSize);
+                TextProtocol::MessageView::FromBlock(block, m_nNextBlockSize, message);
+            }
+            else    //No AVR message is so long. Skipping it, empty view will be reported as unknown message.
+            {
+                for (int left = m_nNextBlockSize; left > 0; left -= TextProtocol::MaxBlockSize)
+                    m_pTcpSocket->read(reinterpret_cast<char*>(block), qMin(left, TextProtocol::MaxBlockSize));
+            }
+            m_nNextBlockSize = 0;
+            HandleServerMessage(message);   //Parse received data
+        }
+    }
+
+    void AsyncClient::HandleServerMessage(const TextProtocol::MessageView& message)    //Parses messages from AVR host
+    {
+        //Message is parsed in place, no strings are created unless it's text message
+        TextProtocol::Reply reply = TextProtocol::ParseReply(message);
+        switch(reply.token)   //Parsing message token
+        {
+            case 'p':   // "\p" token means AVR saying it's current position. It may be untrue, but 0 is always true.
+                OnPosition(reply.arg0, reply.requestId);
+                break;
+
+            case 'm':   // "\m" token means text message. Text message with request ID or error prefix is error reply.
+            {
+                QString text = message.ToString(reply.textFrom, reply.textTo);
+                bool isError = text.startsWith(errorPrefix);
+                if (isError)
+                    text.remove(0, errorPrefix.size());
+                if (!isError && !reply.requestId)
+                {
+                    emit TextMessage(text);
+                    break;
+                }
+                //Server takes error texts from the same table, so code is found by text
+                for (Protocol::ErrorCode code : Protocol::ErrorCodes)
+                {
+                    if (text == Protocol::ErrorText(code))
+                    {
+                        OnError(true, code, text, reply.requestId);
+                        return;
+                    }
+                }
+                OnError(false, Protocol::ErrorCode::UnknownMessage, text, reply.requestId);
+                break;
+            }
+
+            case 's':   // "\s" token means AVR reporting about successfuly finished move operation.
+                OnSuccess(reply.requestId);
+                break;
+
+            case 'w':   // "\w" token means AVR reached waypoint of trajectory. Waypoint index and position come after it.
+                OnWaypointReached(reply.arg0, reply.arg1, reply.requestId);
+                break;
+
+            case 'h':   // "\h" token means move was interrupted by Stop or Retarget order. Position is always true.
+                OnHalted(reply.arg0, reply.requestId);
+                break;
+
+            case 'o':   // "\o" token means AVR already has controlling client and we can only watch it.
+                        // We'll see replies to its orders too, they don't match our requests.
+                m_bObserver = true;
+                emit ObserverMode();
+                break;
+
+            case 't':   // "\t" token means position update which we subscribed for. It may be untrue as \p.
+                emit PositionUpdated(reply.arg0);
+                break;
+
+            case 'i':   // "\i" token means AVR initializing client data. Example: \i200:15000
+                        // It means current position is 200 (ALWAYS true) and max is 15000.
+                OnInit(reply.arg0, reply.arg1);
+                break;
+
+            case 'r':   // "\r" means AVR says it received client's message and it's going to execute it.
+                        // Example: \r1:56 means we requested to move (code 1) for 56 steps.
+                OnReceived(reply.arg0, reply.arg1, reply.hasArg1, reply.requestId);
+                break;
+
+            case 'v':   // "\v" means answer to our request of protocol version.
+                        // \v2:<DeviceID> means everything after this message is binary, \v1 means text protocol.
+                        // Device ID after version means server supports request IDs.
+                m_bRequestIds = reply.hasArg1;
+                if(reply.arg0 == Protocol::BinaryVersion)
+                {
+                    m_iDeviceId = quint16(reply.arg1);
+                    m_bBinary = true;
+                }
+                OnProtocolChosen();
+                break;
+
+            case 'q':   // "\q" means answer to our metrics query. Report text comes after token.
+                emit MetricsReceived(message.ToString(reply.textFrom, reply.textTo));
+                break;
+
+            case 0:     //Check if special AVR message token exists (\p, \r, \m, etc.)
+                emit UnknownReply("Unknown server message: " + message.ToString());
+                break;
+
+            default:    //If unknown token was received from server.
+                emit UnknownReply(QString("Unknown responce token '\\%1'").arg(QChar(reply.token)));
+        }
+    }
+
+    void AsyncClient::HandleServerRecord(const Protocol::Record& record)    //Handles binary records from AVR host
+    {
+        switch(record.opcode)
+        {
+            case Protocol::Opcode::Position:
+                OnPosition(record.arg0, record.requestId);
+                break;
+
+            case Protocol::Opcode::Success:
+                OnSuccess(record.requestId);
+                break;
+
+            case Protocol::Opcode::WaypointReached:
+                OnWaypointReached(record.arg0, record.arg1, record.requestId);
+                break;
+
+            case Protocol::Opcode::Halted:
+                OnHalted(record.arg0, record.requestId);
+                break;
+
+            case Protocol::Opcode::Telemetry:
+                emit PositionUpdated(record.arg0);
+                break;
+
+            case Protocol::Opcode::Init:
+                OnInit(record.arg0, record.arg1);
+                break;
+
+            case Protocol::Opcode::Received:
+                OnReceived(record.arg0, record.arg1, record.arg0 == int(MessageType::MoveForNSteps) ||
+                           record.arg0 == int(MessageType::Subscribe) || record.arg0 == int(MessageType::Retarget) ||
+                           record.arg0 == int(MessageType::MoveTo) || record.arg0 == int(MessageType::Trajectory),
+                           record.requestId);
+                break;
+
+            case Protocol::Opcode::Error:
+            {
+                Protocol::ErrorCode code = Protocol::ErrorCode(record.arg0);
+                OnError(true, code, ErrorText(code), record.requestId);
+                break;
+            }
+
+            default:    //If unknown opcode was received from server.
+                emit UnknownReply(QString().sprintf("Unknown responce opcode 0x%02X", unsigned(record.opcode)));
+        }
+    }
+
+    void AsyncClient::OnInit(int currentPos, int maxPos)
+    {
+        m_iMaxPos = maxPos;
+        m_iInitPos = currentPos;
+        m_bInitialized = true;  //Now we know initial position of AVR system and maximum threshold of steps
+        SetReadyIfInitialized();
+    }
+
+    void AsyncClient::OnProtocolChosen()
+    {
+        m_bProtocolChosen = true;
+        emit ProtocolChosen(m_bBinary, m_bRequestIds);
+        SetReadyIfInitialized();
+    }
+
+    void AsyncClient::SetReadyIfInitialized()
+    {
+        //Server sends \i after asking AVR thread, so it often comes before answer to \v. Orders sent before
+        //the answer would go by text protocol without request IDs, while server may be reading binary already.
+        if (m_bReady || !m_bInitialized || !m_bProtocolChosen)
+            return;
+        m_bReady = true;
+        emit Ready(m_iInitPos, m_iMaxPos);
+    }
+
+    void AsyncClient::OnReceived(int code, int steps, bool hasSteps, quint32 requestId)
+    {
+        emit OrderReceived(requestId, code, steps, hasSteps);
+        //There are no other replies to subscription, updates are not replies
+        if (code == int(MessageType::Subscribe))
+            CompleteRequest(requestId, IsSubscribe, RequestResult());
+        else if (code == int(MessageType::Unsubscribe))
+            CompleteRequest(requestId, IsUnsubscribe, RequestResult());
+    }
+
+    void AsyncClient::OnPosition(int pos, quint32 requestId)
+    {
+        emit PositionReceived(requestId, pos);
+        RequestResult result;
+        result.position = pos;
+        CompleteRequest(requestId, IsPositionRequest, result);  //Position is the last reply to position request
+    }
+
+    void AsyncClient::OnSuccess(quint32 requestId)
+    {
+        emit MoveComplete(requestId);
+        CompleteRequest(requestId, IsSuccessful, RequestResult());
+    }
+
+    void AsyncClient::OnHalted(int pos, quint32 requestId)
+    {
+        emit MoveHalted(requestId, pos);
+        RequestResult result;
+        result.status = RequestStatus::Halted;
+        result.position = pos;
+        CompleteRequest(requestId, IsMove, result);     //It's the last reply to move order instead of success
+    }
+
+    void AsyncClient::OnWaypointReached(int index, int pos, quint32 requestId)
+    {
+        emit WaypointReached(requestId, index, pos);
+        Request* request = FindRequest(requestId, IsTrajectory);   //It's not the last reply, success comes after the last waypoint
+        if (request && request->waypoint)
+        {
+            WaypointCallback waypoint = request->waypoint;  //Callback may send orders, request could move after it
+            waypoint(index, pos);
+        }
+    }
+
+    void AsyncClient::OnError(bool hasCode, Protocol::ErrorCode code, const QString& text, quint32 requestId)
+    {
+        emit ErrorReceived(requestId, text);
+        if (!m_bProtocolChosen)     //Nothing but \v was sent yet. Server is too old to know it, it stays on text protocol.
+        {
+            OnProtocolChosen();
+            return;
+        }
+        RequestResult result;
+        result.status = RequestStatus::Failed;
+        result.hasErrorCode = hasCode;
+        result.error = code;
+        result.errorText = text;
+        CompleteRequest(requestId, AnyRequest, result);     //Error is the last reply to request
+    }
+
+    QString AsyncClient::ErrorText(Protocol::ErrorCode code)
+    {
+        return Protocol::ErrorText(code);
+    }
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <functional>
+#include "avrprotocol.h"
+#include "avrtextprotocol.h"
+
+namespace AVR
+{
+    enum class MessageType    //All possible messages
+    {
+        Unknown,
+        MoveForNSteps,
+        MoveToZero,
+        GetPosition,
+        Subscribe,      //Steps are interval of position updates in milliseconds, 0 means every position change
+        Unsubscribe,
+        Stop,           //Stops current move and cancels queued move orders
+        Retarget,       //Steps are new goal position of current move
+        MoveTo,         //Steps are goal position
+        Trajectory,     //Moves through list of waypoints. Sent by FollowTrajectory().
+        TYPE_MAX
+    };
+
+    enum class RequestStatus    //How request has ended
+    {
+        Success,        //Order is done: move is complete, position is received, subscription is changed
+        Halted,         //Move was interrupted by Stop or Retarget order
+        Failed,         //AVR answered with error
+        Disconnected    //Connection was closed before the last reply came
+    };
+
+    //Parsed last reply to request
+    struct RequestResult
+    {
+        RequestStatus status = RequestStatus::Success;
+        int position = -1;          //Reported position for GetPosition (may be untrue), true stop position for halted move.
+                                    //-1 for other requests.
+        bool hasErrorCode = false;  //Is error code known. Old servers may send error texts which client doesn't know.
+        Protocol::ErrorCode error = Protocol::ErrorCode::UnknownMessage;
+        QString errorText;          //Error description without "AVR Error: " prefix
+
+        bool IsOk() const { return status == RequestStatus::Success; }
+    };
+
+    using ResultCallback = std::function<void(const RequestResult&)>;
+    using WaypointCallback = std::function<void(int index, int pos)>;   //Waypoint of trajectory is reached
+
+    //Asynchronous AVR client without any UI. Orders are sent at once and many of them may be in flight,
+    //every order can have callback which gets its parsed result. Callbacks and signals are called in the thread
+    //of client object by its event loop.
+    //Every reply is also reported by signal, so UI can show all of them without parsing anything.
+    class AsyncClient : public QObject
+    {
+        Q_OBJECT
+
+    private:
+        struct Request  //Sent request which waits for its last reply
+        {
+            MessageType type;
+            ResultCallback done;
+            WaypointCallback waypoint;
+        };
+
+        QTcpSocket* m_pTcpSocket;   //Connection socket
+        quint16 m_nNextBlockSize;   //Socket's next block size
+        bool m_bConnected;          //Connection state of client (connected or not)
+        bool m_bReady;              //Did AVR send its position and max position and server choose protocol (client can give orders)
+        bool m_bInitialized;        //Did AVR send its position and max position. It may come before protocol answer.
+        int m_iInitPos;             //Position which AVR sent with init data
+        bool m_bProtocolChosen;     //Did server answer which protocol it supports
+        int m_iMaxPos;              //Maximum available AVR position. Initialy requested from server.
+        bool m_bUseBinary;          //Should client ask server for binary protocol when connected
+        bool m_bBinary;             //Is binary protocol on (server confirmed it)
+        quint16 m_iDeviceId;        //Device ID for binary records. Server says it when confirms binary protocol.
+        bool m_bRequestIds;         //Does server support request IDs (it says so in answer to \v)
+        bool m_bObserver;           //Is this connection read-only observer (AVR already has controlling client)
+        quint32 m_iLastRequestId;   //ID of last sent request. IDs go 1, 2, 3... and skip 0.
+        QHash<quint32, Request> m_Requests;     //Requests in flight by their IDs
+        QList<Request> m_Unnumbered;            //Requests in flight in order of sending, if server doesn't support IDs.
+                                                //Replies are matched with the oldest request which expects them.
+
+        void HandleServerMessage(const TextProtocol::MessageView& message);   //Method for parsing incoming messages from server.
+        void HandleServerRecord(const Protocol::Record& record);    //Method for handling incoming binary records.
+        void sendText(const QString& str);  //Sends text protocol message to server
+        quint32 NextRequestId();    //Returns ID for new request or 0 if server doesn't support request IDs
+        quint32 AddRequest(MessageType type, const ResultCallback& done, const WaypointCallback& waypoint);
+        bool FailIfNotReady(const ResultCallback& done);    //Reports failure later if orders can't be sent now
+
+        //Finds request which this reply belongs to, filter tells which requests expect it.
+        //Without request ID it's the oldest one accepted by filter.
+        Request* FindRequest(quint32 requestId, bool (*filter)(MessageType));
+        void CompleteRequest(quint32 requestId, bool (*filter)(MessageType), const RequestResult& result);
+
+        //Handlers of server replies. They are the same for text and binary protocols.
+        //requestId is ID of request this is reply to, 0 if server didn't send it.
+        void OnInit(int currentPos, int maxPos);
+        void OnProtocolChosen();
+        void SetReadyIfInitialized();   //Client is ready when both init data and protocol answer came, in any order
+        void OnReceived(int code, int steps, bool hasSteps, quint32 requestId);
+        void OnPosition(int pos, quint32 requestId);
+        void OnSuccess(quint32 requestId);
+        void OnHalted(int pos, quint32 requestId);
+        void OnWaypointReached(int index, int pos, quint32 requestId);
+        void OnError(bool hasCode, Protocol::ErrorCode code, const QString& text, quint32 requestId);
+
+    public:
+        AsyncClient(QObject* parent = 0);
+        ~AsyncClient();
+
+        //Connects client to AVR host. If binaryProtocol is true client asks server for binary protocol,
+        //and stays on text protocol if server doesn't support it. Ready() is emitted when orders can be sent.
+        void Connect(const QString& strHost, int nPort, bool binaryProtocol = false);
+        //Closes connection. Requests in flight are finished with Disconnected status.
+        void Disconnect();
+        bool IsConnected() const;   //Checks current connection state
+        bool IsReady() const;       //Checks whether AVR is initialized and orders can be sent
+        bool IsBinary() const;      //Checks whether binary protocol is on
+        bool HasRequestIds() const; //Checks whether server matches replies by request IDs
+        bool IsObserver() const;    //Checks whether connection is read-only. Observer sees all replies of controlling client
+                                    //without their request IDs.
+        int GetMaxPosition() const; //Returns maximum AVR position, 0 if AVR isn't ready
+        int GetRequestsInFlight() const;    //Returns count of sent requests which are not complete yet
+
+        //Orders to AVR. They don't wait for reply, callback is called when the last reply comes.
+        //They return request ID, which marks all replies to this order in signals (0 if server doesn't support IDs).
+        quint32 MoveBy(int steps, const ResultCallback& done = ResultCallback());
+        quint32 MoveToZero(const ResultCallback& done = ResultCallback());
+        quint32 MoveTo(int pos, const ResultCallback& done = ResultCallback());
+        quint32 GetPosition(const ResultCallback& done = ResultCallback());
+        quint32 Stop(const ResultCallback& done = ResultCallback());
+        quint32 Retarget(int pos, const ResultCallback& done = ResultCallback());
+        quint32 Subscribe(int interval, const ResultCallback& done = ResultCallback());
+        quint32 Unsubscribe(const ResultCallback& done = ResultCallback());
+        //AVR moves to every waypoint one by one. waypoint callback is called for each of them, done after the last one.
+        quint32 FollowTrajectory(const QVector<int>& waypoints, const ResultCallback& done = ResultCallback(),
+                                 const WaypointCallback& waypoint = WaypointCallback());
+        //Sends any order which has one argument or none of them (all except trajectory)
+        quint32 Send(MessageType msg, int steps = 0, const ResultCallback& done = ResultCallback());
+
+        //Asks server for metrics report, it comes by MetricsReceived() signal. Works only on text protocol,
+        //returns false if connection isn't ready or it's binary.
+        bool QueryMetrics();
+
+        static QString ErrorText(Protocol::ErrorCode code);     //Returns description of error code
+
+    private slots:
+        void slotReadyRead();       //This slot triggers by QTcpSocket::readyRead signal. Processes all incoming messages.
+        void slotError(QAbstractSocket::SocketError err);   //Triggers when any error happens on QTcpSocket.
+        void slotConnected();      //Triggered when connected to AVR host.
+
+    signals:
+        void Connected();           //Socket is connected, client asks server for protocol
+        void ProtocolChosen(bool binary, bool requestIds);  //Server answered what it supports
+        void Ready(int currentPos, int maxPos);     //AVR is initialized and protocol is chosen, its position is always true
+        void SocketError(QAbstractSocket::SocketError err, const QString& text);    //Connection is closed after it
+        void Disconnected();        //Connection is closed, requests in flight are finished
+
+        //Replies of AVR. requestId is 0 if server doesn't support request IDs.
+        void OrderReceived(quint32 requestId, int code, int steps, bool hasSteps);  //AVR is going to execute order
+        void PositionReceived(quint32 requestId, int pos);  //Reply to position request. It may be untrue.
+        void MoveComplete(quint32 requestId);
+        void MoveHalted(quint32 requestId, int pos);
+        void WaypointReached(quint32 requestId, int index, int pos);
+        void ErrorReceived(quint32 requestId, const QString& text);
+        void RequestComplete(quint32 requestId);    //Request got its last reply and its callback was called
+        void PositionUpdated(int pos);  //Position update from AVR after subscription. It may be untrue as position reply.
+        void ObserverMode();            //AVR already has controlling client, only position requests are allowed
+        void TextMessage(const QString& text);      //Text message from AVR which isn't reply to request
+        void UnknownReply(const QString& text);     //Message which client can't parse, text describes it
+        void MetricsReceived(const QString& report);    //Answer to QueryMetrics() in Prometheus text format
+    };
+}
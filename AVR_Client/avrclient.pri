@@ -0,0 +1,11 @@
+# Links AVR client library (libavrclient) to application.
+# It's built by AVR_Client project, which goes before applications in AVR.pro.
+
+QT += network
+
+INCLUDEPATH += $$PWD $$PWD/../Common
+
+LIBS += -L$$OUT_PWD/../bin/lib -lavrclient
+
+win32-msvc*: PRE_TARGETDEPS += $$OUT_PWD/../bin/lib/avrclient.lib
+else: PRE_TARGETDEPS += $$OUT_PWD/../bin/lib/libavrclient.a
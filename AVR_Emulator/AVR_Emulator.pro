@@ -24,18 +24,14 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 
+include(avrcore.pri)
+
 SOURCES += \
         main.cpp \
-        mainwindow.cpp \
-    avrsystem.cpp \
-    avrserver.cpp \
-    avrmessage.cpp
+        mainwindow.cpp
 
 HEADERS += \
-        mainwindow.h \
-    avrsystem.h \
-    avrserver.h \
-    avrmessage.h
+        mainwindow.h
 
 FORMS += \
         mainwindow.ui
@@ -0,0 +1,79 @@
+#include "avrclock.h"
+#include <cmath>
+
+namespace AVR
+{
+    Clock::Clock(Mode mode, double scale)
+        : m_VirtualTime(0)
+    {
+        m_Mode = mode;
+        m_dScale = mode == Mode::Scaled ? scale : 1.0;
+    }
+
+    Clock::Clock(const Clock& copy)  //Copy ctor
+        : m_VirtualTime(copy.m_VirtualTime.load())
+    {
+        m_Mode = copy.m_Mode;
+        m_dScale = copy.m_dScale;
+        m_Timer = copy.m_Timer;
+    }
+
+    Clock& Clock::operator=(const Clock& clock)
+    {
+        m_Mode = clock.m_Mode;
+        m_dScale = clock.m_dScale;
+        m_Timer = clock.m_Timer;
+        m_VirtualTime = clock.m_VirtualTime.load();
+        return *this;
+    }
+
+    Clock::Mode Clock::GetMode() const
+    {
+        return m_Mode;
+    }
+
+    double Clock::GetScale() const
+    {
+        return m_dScale;
+    }
+
+    void Clock::Start()
+    {
+        m_Timer.start();
+        m_VirtualTime = 0;
+    }
+
+    qint64 Clock::Now() const
+    {
+        switch(m_Mode)
+        {
+            case Mode::Scaled:
+                return qint64(m_Timer.elapsed() * m_dScale);
+
+            case Mode::Virtual:
+                return m_VirtualTime.load(std::memory_order_acquire);
+
+            default:
+                return m_Timer.elapsed();
+        }
+    }
+
+    int Clock::TimerInterval(qint64 deadline) const
+    {
+        if(m_Mode == Mode::Virtual)     //No need to wait in virtual time
+            return 0;
+
+        qint64 remaining = deadline - Now();
+        if(remaining <= 0)
+            return 0;
+        if(m_Mode == Mode::Scaled)  //Rounding up, so timer never fires before deadline
+            remaining = qint64(std::ceil(remaining / m_dScale));
+        return int(remaining);
+    }
+
+    void Clock::AdvanceTo(qint64 deadline)
+    {
+        if(m_Mode == Mode::Virtual && deadline > m_VirtualTime.load(std::memory_order_relaxed))
+            m_VirtualTime.store(deadline, std::memory_order_release);   //Jumping to the event
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <atomic>
+
+namespace AVR
+{
+    //Simulation clock of AVR System. All AVR timings are measured by it instead of real time.
+    //It can go as real time, go faster (or slower) than real time with constant scale,
+    //or be fully virtual: virtual time stands still until AVR asks it to jump to next event.
+    //Now() could be called from any thread, other methods only from thread of clock owner.
+    class Clock
+    {
+    public:
+        enum class Mode
+        {
+            RealTime,   //Simulated time equals real time
+            Scaled,     //Simulated time goes m_dScale times faster than real time
+            Virtual     //Simulated time jumps to the next event instantly
+        };
+
+    private:
+        Mode m_Mode;            //Current mode of the clock
+        double m_dScale;        //Speed of simulated time relative to real time (Scaled mode only)
+        QElapsedTimer m_Timer;  //Real time source
+        std::atomic<qint64> m_VirtualTime;  //Current simulated time (Virtual mode only)
+
+    public:
+        Clock(Mode mode = Mode::RealTime, double scale = 1.0);
+        Clock(const Clock& copy);
+        Clock& operator=(const Clock& clock);
+
+        Mode GetMode() const;
+        double GetScale() const;
+
+        void Start();                               //Starts counting time from 0
+        qint64 Now() const;                         //Returns current simulated time in milliseconds
+        int TimerInterval(qint64 deadline) const;   //Returns how much real milliseconds to wait until simulated deadline
+        void AdvanceTo(qint64 deadline);            //Says that deadline was waited for. Virtual clock jumps to it.
+    };
+}
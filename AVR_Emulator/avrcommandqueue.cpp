@@ -0,0 +1,119 @@
+#include "avrcommandqueue.h"
+#include "avrtrace.h"
+
+namespace AVR
+{
+    CommandQueue::CommandQueue(int capacity)
+    {
+        m_iHead = 0;
+        m_iCount = 0;
+        m_iMaxDepth = 0;
+        m_bNotifyPending = false;
+        SetCapacity(capacity);
+    }
+
+    void CommandQueue::SetCapacity(int capacity)
+    {
+        QMutexLocker locker(&m_Mutex);
+        m_Items.fill(Message(), qMax(capacity, 1));
+        m_iHead = 0;
+        m_iCount = 0;
+    }
+
+    int CommandQueue::Capacity() const
+    {
+        QMutexLocker locker(&m_Mutex);
+        return m_Items.size();
+    }
+
+    int CommandQueue::Depth() const
+    {
+        QMutexLocker locker(&m_Mutex);
+        return m_iCount;
+    }
+
+    int CommandQueue::MaxDepth() const
+    {
+        QMutexLocker locker(&m_Mutex);
+        return m_iMaxDepth;
+    }
+
+    bool CommandQueue::IsFull() const
+    {
+        QMutexLocker locker(&m_Mutex);
+        return m_iCount == m_Items.size();
+    }
+
+    Message& CommandQueue::At(int index)
+    {
+        return m_Items[(m_iHead + index) % m_Items.size()];
+    }
+
+    bool CommandQueue::Push(const Message& msg, bool& notify)
+    {
+        QMutexLocker locker(&m_Mutex);
+        notify = false;
+        if(m_iCount == m_Items.size())
+            return false;
+        m_iCount++;
+        At(m_iCount - 1) = msg;
+        if(msg.GetRequestId())
+            Trace::AsyncBegin("queue wait", this, msg.GetRequestId());   //It ends in consumer's thread
+        m_iMaxDepth = qMax(m_iMaxDepth, m_iCount);
+        if(!m_bNotifyPending)   //Consumer gets only one wake up for any count of commands
+        {
+            m_bNotifyPending = true;
+            notify = true;
+        }
+        return true;
+    }
+
+    void CommandQueue::StartTaking()
+    {
+        QMutexLocker locker(&m_Mutex);
+        m_bNotifyPending = false;
+    }
+
+    bool CommandQueue::TakeNext(Message& msg, bool skipMoveOrders, bool& wasFull)
+    {
+        QMutexLocker locker(&m_Mutex);
+        int index = 0;
+        if(skipMoveOrders)  //Move orders keep waiting for their turn
+            while(index < m_iCount && At(index).IsMoveOrder())
+                index++;
+        if(index >= m_iCount)
+            return false;
+
+        wasFull = m_iCount == m_Items.size();
+        msg = At(index);
+        for(int i = index; i > 0; i--)  //Closing the gap: commands older than taken one are shifted by one place
+            At(i) = At(i - 1);
+        At(0) = Message();  //Free slot doesn't keep waypoints of taken trajectory
+        m_iHead = (m_iHead + 1) % m_Items.size();
+        m_iCount--;
+        if(msg.GetRequestId())
+            Trace::AsyncEnd("queue wait", this, msg.GetRequestId());
+        return true;
+    }
+
+    void CommandQueue::TakeMoveOrders(QVector<Message>& orders, bool& wasFull)
+    {
+        QMutexLocker locker(&m_Mutex);
+        wasFull = m_iCount == m_Items.size();
+        int kept = 0;
+        for(int i = 0; i < m_iCount; i++)
+        {
+            if(At(i).IsMoveOrder())
+            {
+                if(At(i).GetRequestId())
+                    Trace::AsyncEnd("queue wait", this, At(i).GetRequestId());
+                orders.append(At(i));
+            }
+            else
+                At(kept++) = At(i);     //Other commands are moved towards the head
+        }
+        for(int i = kept; i < m_iCount; i++)
+            At(i) = Message();
+        m_iCount = kept;
+    }
+}
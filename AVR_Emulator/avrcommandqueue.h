@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QMutex>
+#include <QVector>
+#include "avrmessage.h"
+
+namespace AVR
+{
+    //Bounded queue of client's commands between server (producer) and AVR System (consumer).
+    //It lives in AVR System, but server pushes to it from its own thread, so all methods are thread-safe.
+    //Queue never grows over its capacity: when it's full server stops reading client's socket or rejects commands.
+    //Move orders wait in queue while AVR is moving, other commands are taken out of turn and executed at once.
+    class CommandQueue
+    {
+    public:
+        enum class OverloadPolicy   //What server does with client's commands when queue is full
+        {
+            Block,      //Stop reading socket until AVR takes something from queue (TCP flow control slows client down)
+            Reject      //Reply with "queue is full" error at once
+        };
+
+    private:
+        mutable QMutex m_Mutex;     //Guards all members below
+        QVector<Message> m_Items;   //Ring buffer of commands. Its size is queue capacity.
+        int m_iHead;                //Index of oldest command in ring buffer
+        int m_iCount;               //Count of commands in queue
+        int m_iMaxDepth;            //Largest count of commands which was in queue
+        bool m_bNotifyPending;      //Consumer was woken up and didn't start taking commands yet
+
+        //Disallow copying
+        CommandQueue(const CommandQueue&) = delete;
+        CommandQueue& operator=(const CommandQueue&) = delete;
+
+        Message& At(int index);     //Returns command with index counted from the oldest one
+
+    public:
+        CommandQueue(int capacity = 64);
+
+        void SetCapacity(int capacity);     //Changes capacity. Commands in queue are dropped.
+        int Capacity() const;
+        int Depth() const;      //Returns count of commands in queue now
+        int MaxDepth() const;   //Returns largest count of commands which was in queue
+        bool IsFull() const;
+
+        //Adds command to the end of queue. Returns false if queue is full.
+        //notify is set to true if consumer must be woken up, it happens only once until consumer calls StartTaking().
+        bool Push(const Message& msg, bool& notify);
+
+        void StartTaking();     //Says that consumer woke up. Commands pushed after it will wake it up again.
+        //Takes the oldest command. If skipMoveOrders is true takes the oldest command which is not move order.
+        //Returns false if there is no such command. wasFull is set to true if queue was full before this call.
+        bool TakeNext(Message& msg, bool skipMoveOrders, bool& wasFull);
+        //Takes all move orders out of queue (e.g. for cancelling them), other commands keep their order.
+        //wasFull is set to true if queue was full before this call.
+        void TakeMoveOrders(QVector<Message>& orders, bool& wasFull);
+    };
+}
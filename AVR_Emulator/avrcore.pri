@@ -0,0 +1,38 @@
+# AVR emulator core: AVR System, its server and host of devices.
+# It doesn't depend on QtWidgets and is shared by GUI and headless emulator targets.
+
+QT       += core network
+
+INCLUDEPATH += $$PWD $$PWD/../Common
+
+SOURCES += \
+    $$PWD/avrsystem.cpp \
+    $$PWD/avrserver.cpp \
+    $$PWD/avrmessage.cpp \
+    $$PWD/avrmotion.cpp \
+    $$PWD/avrclock.cpp \
+    $$PWD/avrhost.cpp \
+    $$PWD/avrsettings.cpp \
+    $$PWD/avrsnapshot.cpp \
+    $$PWD/avrcommandqueue.cpp \
+    $$PWD/avrrandom.cpp \
+    $$PWD/avrmetrics.cpp \
+    $$PWD/avrmetricsserver.cpp \
+    $$PWD/avrtrace.cpp
+
+HEADERS += \
+    $$PWD/avrsystem.h \
+    $$PWD/avrserver.h \
+    $$PWD/avrmessage.h \
+    $$PWD/avrmotion.h \
+    $$PWD/avrclock.h \
+    $$PWD/avrhost.h \
+    $$PWD/avrsettings.h \
+    $$PWD/avrsnapshot.h \
+    $$PWD/avrcommandqueue.h \
+    $$PWD/avrrandom.h \
+    $$PWD/avrmetrics.h \
+    $$PWD/avrmetricsserver.h \
+    $$PWD/avrtrace.h \
+    $$PWD/../Common/avrprotocol.h \
+    $$PWD/../Common/avrtextprotocol.h
@@ -0,0 +1,178 @@
+#include "avrhost.h"
+#include <QDebug>
+
+namespace AVR
+{
+    DeviceHost::DeviceHost(QObject* parent)
+        : QObject(parent)
+    {
+        m_pMetrics = nullptr;
+        //Registering our types for Qt signals
+        qRegisterMetaType<AVR::Message>("AVR::Message");
+        qRegisterMetaType<AVR::Message::Type>("Message::Type");
+        qRegisterMetaType<AVR::AVRSystem::Error>("AVRSystem::Error");
+    }
+
+    DeviceHost::~DeviceHost()
+    {
+        Stop();
+    }
+
+    void DeviceHost::Start(const Settings& settings)
+    {
+        Stop();     //Clean-up previous devices if host was already started
+
+        //Servers start listening in this thread, so listen error could be passed to caller as exception
+        m_Servers.reserve(settings.deviceCount);
+        for(int i = 0; i < settings.deviceCount; i++)
+        {
+            try
+            {
+                m_Servers.append(new Server(settings.host, settings.port + i)); //Trying to create and host AVR server entity
+            }
+            catch(...)  //If server init failed - destroy everything created before and pass error to caller
+            {
+                qDeleteAll(m_Servers);
+                m_Servers.clear();
+                throw;
+            }
+        }
+        if(settings.metricsPort)    //Metrics endpoint listens in this thread too, its error is passed the same way
+        {
+            try
+            {
+                m_pMetrics = new MetricsServer(settings.metricsPort, this);
+            }
+            catch(...)
+            {
+                qDeleteAll(m_Servers);
+                m_Servers.clear();
+                throw;
+            }
+        }
+
+        //One worker per CPU core, but no more workers than devices
+        int workerCount = qMin(qMax(QThread::idealThreadCount(), 1), settings.deviceCount);
+        for(int i = 0; i < workerCount; i++)
+        {
+            m_Workers.append(new QThread(this));
+            m_Workers.last()->setObjectName(QStringLiteral("AVR worker %1").arg(i));   //Thread name in debugger and trace
+        }
+
+        //Network threads mostly wait for sockets, so they are fewer than workers unless count is set by user
+        int ioThreadCount = settings.ioThreadCount;
+        if(ioThreadCount == 0)
+            ioThreadCount = qMax(QThread::idealThreadCount() / 4, 1);
+        ioThreadCount = qMin(ioThreadCount, settings.deviceCount);
+        for(int i = 0; i < ioThreadCount; i++)
+        {
+            m_IOThreads.append(new QThread(this));
+            m_IOThreads.last()->setObjectName(QStringLiteral("AVR network %1").arg(i));
+        }
+
+        m_Devices.reserve(settings.deviceCount);
+        for(int i = 0; i < settings.deviceCount; i++)
+        {
+            Server* server = m_Servers[i];
+            AVRSystem* avr = new AVRSystem(settings.chanceToLie, settings.maxPos, settings.clock);
+            avr->SetDisplayRate(settings.displayRate);
+            avr->SetQueueCapacity(settings.queueDepth);
+            avr->SetMotionProfile(settings.profiles[i % settings.profiles.size()]);
+            if(settings.hasSeed)
+                avr->SetRandomSeed(Random::Mix(settings.seed + quint64(i)));  //Devices don't repeat each other's lies
+            avr->moveToThread(m_Workers[i % workerCount]);   //Moving AVR System to its worker thread
+            server->moveToThread(m_IOThreads[i % ioThreadCount]);   //Listening socket goes together with server
+            m_Devices.append(avr);
+            server->AttachAVR(avr);     //Server answers position requests by itself
+            server->SetDeviceId(quint16(i));
+            server->AttachQueue(avr->GetCommandQueue(), settings.overload);    //Server pushes commands right to AVR's queue
+
+            //Connecting all slots and events of AVR System and Server. They live in different threads, so all of them are queued.
+            QObject::connect(server, &Server::CommandsQueued, avr, &AVRSystem::OnCommandsQueued, Qt::QueuedConnection);   //Wakes up AVR thread for queued commands
+            QObject::connect(avr, &AVRSystem::QueueHasSpace, server, &Server::OnQueueHasSpace);
+            QObject::connect(avr, &AVRSystem::WorkIsComplete, server, &Server::AVRWorkIsComplete);
+            QObject::connect(avr, &AVRSystem::SendPosition, server, &Server::SendPosition);
+            QObject::connect(avr, &AVRSystem::ErrorOccurred, server, &Server::OnAVRError);
+            QObject::connect(avr, &AVRSystem::MessageReceived, server, &Server::OnMessageReceived);
+            QObject::connect(avr, &AVRSystem::WaypointReached, server, &Server::OnWaypointReached);
+            QObject::connect(avr, &AVRSystem::MoveHalted, server, &Server::OnMoveHalted);
+            QObject::connect(avr, &AVRSystem::Telemetry, server, &Server::OnTelemetry);
+            QObject::connect(avr, &AVRSystem::ClientInit, server, &Server::OnClientInit);
+            QObject::connect(server, &Server::AskForClientInit, avr, &AVRSystem::OnClientInitRequest);
+            QObject::connect(server, &Server::ClientDisconnected, avr, &AVRSystem::OnClientDisconnected);
+        }
+
+        if(m_pMetrics)
+            m_pMetrics->SetDevices(m_Devices);
+        if(!settings.traceFile.isEmpty())
+        {
+            m_TraceFile = settings.traceFile;
+            Trace::Start();
+        }
+
+        //Launching worker and network threads
+        for(QThread* worker : m_Workers)
+            worker->start();
+        for(QThread* ioThread : m_IOThreads)
+            ioThread->start();
+    }
+
+    void DeviceHost::Stop()
+    {
+        delete m_pMetrics;  //It reads devices, so it goes first
+        m_pMetrics = nullptr;
+
+        //Every object is destroyed in its own thread, because its timers and sockets can't be stopped from another one.
+        //Objects passed to deleteLater() are destroyed when their thread finishes.
+        for(Server* server : m_Servers)
+            server->deleteLater();
+        for(AVRSystem* avr : m_Devices)
+            avr->deleteLater();
+        for(QThread* thread : m_IOThreads + m_Workers)
+        {
+            thread->quit();
+            thread->wait();
+        }
+
+        if(!m_TraceFile.isEmpty())  //All threads are finished, their events are complete
+        {
+            Trace::Stop();
+            QString error;
+            if(!DumpTrace(error))
+                qWarning().noquote() << "Trace Error:" << error;
+            m_TraceFile.clear();
+        }
+
+        qDeleteAll(m_IOThreads);
+        qDeleteAll(m_Workers);
+        m_Devices.clear();
+        m_Servers.clear();
+        m_IOThreads.clear();
+        m_Workers.clear();
+    }
+
+    bool DeviceHost::DumpTrace(QString& error) const
+    {
+        if(m_TraceFile.isEmpty())
+        {
+            error = "Tracing is off. Launch emulator with -trace <File> argument.";
+            return false;
+        }
+        return Trace::Dump(m_TraceFile, error);
+    }
+
+    int DeviceHost::GetDeviceCount() const
+    {
+        return m_Devices.size();
+    }
+
+    AVRSystem* DeviceHost::GetDevice(int index) const
+    {
+        return m_Devices.value(index, nullptr);
+    }
+
+    Server* DeviceHost::GetServer(int index) const
+    {
+        return m_Servers.value(index, nullptr);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QObject>
+#include <QThread>
+#include <QVector>
+#include <QHostAddress>
+#include "avrsystem.h"
+#include "avrserver.h"
+#include "avrsettings.h"
+#include "avrmetricsserver.h"
+#include "avrtrace.h"
+
+namespace AVR
+{
+    //Host of AVR devices. It runs one or many AVR Systems in one process.
+    //Every device has its own server listening its own port (first port + device index).
+    //Devices are spread over fixed pool of worker threads which size is equal to CPU core count,
+    //so thousands of devices don't need thousands of threads.
+    //Servers live in their own network threads, so socket reads and writes never wait for UI thread.
+    class DeviceHost : public QObject
+    {
+        Q_OBJECT
+
+    private:
+        QVector<QThread*> m_Workers;    //Worker threads pool. AVR Systems live in these threads.
+        QVector<QThread*> m_IOThreads;  //Network threads pool. Servers live in these threads.
+        QVector<AVRSystem*> m_Devices;  //All AVR Systems. Device with index i lives in worker i % worker count.
+        QVector<Server*> m_Servers;     //Servers of devices. Server with index i serves device with same index.
+        MetricsServer* m_pMetrics;      //Local metrics endpoint. nullptr if it wasn't asked by settings.
+        QString m_TraceFile;            //Where trace is written when host stops. Empty if tracing is off.
+
+        //Disallow copying
+        DeviceHost(const DeviceHost&) = delete;
+        DeviceHost& operator=(const DeviceHost&) = delete;
+
+    public:
+        DeviceHost(QObject* parent = 0);
+        ~DeviceHost();
+
+        //Creates settings.deviceCount AVR Systems and their servers, than launches worker and network threads.
+        //Device i listens port settings.port + i. Throws std::runtime_error if any server can't be started.
+        //Metrics endpoint lives in caller's thread.
+        void Start(const Settings& settings);
+        void Stop();    //Destroys all devices and servers in their threads and stops these threads. Writes trace if it's on.
+        //Writes trace recorded so far to trace file. Returns false and error if tracing is off or file can't be written.
+        bool DumpTrace(QString& error) const;
+
+        int GetDeviceCount() const;
+        AVRSystem* GetDevice(int index) const;
+        Server* GetServer(int index) const;
+    };
+}
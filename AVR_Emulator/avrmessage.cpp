@@ -6,18 +6,30 @@ namespace AVR
     {
         m_Type = Message::Type::Unknown;
         m_stepCount = 0;
+        m_requestId = 0;
     }
 
-    Message::Message(Message::Type type, int steps)
+    Message::Message(Message::Type type, int steps, quint32 requestId)
     {
         m_Type = type;
         m_stepCount = steps;
+        m_requestId = requestId;
+    }
+
+    Message::Message(const QVector<int>& waypoints, quint32 requestId)
+    {
+        m_Type = Message::Type::Trajectory;
+        m_stepCount = waypoints.size();
+        m_requestId = requestId;
+        m_Waypoints = waypoints;
     }
 
     Message::Message(const Message &copy)   //Copy ctor
     {
         m_Type = copy.m_Type;
         m_stepCount = copy.m_stepCount;
+        m_requestId = copy.m_requestId;
+        m_Waypoints = copy.m_Waypoints;
     }
 
     Message::~Message() //No data to destroy
@@ -28,6 +40,8 @@ namespace AVR
     {
         m_Type = msg.m_Type;
         m_stepCount = msg.m_stepCount;
+        m_requestId = msg.m_requestId;
+        m_Waypoints = msg.m_Waypoints;
         return *this;
     }
 
@@ -44,4 +58,21 @@ namespace AVR
     {
         return m_stepCount;
     }
+
+    quint32 Message::GetRequestId() const
+    {
+        return m_requestId;
+    }
+
+    const QVector<int>& Message::GetWaypoints() const
+    {
+        return m_Waypoints;
+    }
+
+    bool Message::IsMoveOrder() const
+    {
+        Message::Type type = GetMessageType();
+        return type == Message::Type::MoveForNSteps || type == Message::Type::MoveToZero ||
+               type == Message::Type::MoveTo || type == Message::Type::Trajectory;
+    }
 }
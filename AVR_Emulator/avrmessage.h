@@ -1,5 +1,8 @@
 #pragma once
 
+#include <QtGlobal>
+#include <QVector>
+
 namespace AVR
 {
     class Message   //Class of incoming message instance.
@@ -12,17 +15,26 @@ namespace AVR
             MoveForNSteps,
             MoveToZero,
             GetPosition,
+            Subscribe,      //Step value is interval of position updates in milliseconds, 0 means every position change
+            Unsubscribe,
+            Stop,           //Stops current move at once and cancels queued move orders
+            Retarget,       //Step value is new goal position of current move. Idle AVR just moves there.
+            MoveTo,         //Step value is goal position
+            Trajectory,     //Moves through list of waypoints one by one. Step value is waypoint count.
             TYPE_MAX
         };
 
     private:
         Message::Type m_Type; //Current message
         int m_stepCount; //Additional field for step value in case of MoveForNSteps message type
+        quint32 m_requestId; //ID of client's request. All replies to this message carry it. 0 if client didn't set it.
+        QVector<int> m_Waypoints; //Positions of Trajectory message. It's shared between copies, so copying is cheap.
 
     public:
         //Default, custom and copy ctors
         Message();
-        Message(Message::Type type, int steps = 0);
+        Message(Message::Type type, int steps = 0, quint32 requestId = 0);
+        Message(const QVector<int>& waypoints, quint32 requestId = 0);  //Trajectory message
         Message(const Message &copy);
 
         ~Message();
@@ -31,5 +43,8 @@ namespace AVR
 
         Message::Type GetMessageType() const;   //Returns type of message
         int GetSteps() const;   //Return count of steps of this message.
+        quint32 GetRequestId() const;   //Returns ID of client's request or 0 if there is no ID.
+        const QVector<int>& GetWaypoints() const;   //Returns waypoints of Trajectory message
+        bool IsMoveOrder() const;   //Checks whether message orders AVR to move. Such messages are executed one by one.
     };
 }
@@ -0,0 +1,235 @@
+#include "avrmetrics.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <QtAlgorithms>
+#include <atomic>
+#include <algorithm>
+
+namespace AVR
+{
+    namespace
+    {
+        const int counterCount = int(Metrics::Counter::COUNTER_MAX);
+        const int commandCount = int(Message::Type::TYPE_MAX);
+        const int replyCount = int(Metrics::Reply::REPLY_MAX);
+        const int errorCount = int(AVRSystem::Error::Cancelled) + 1;
+        const int histogramCount = int(Metrics::Histogram::HISTOGRAM_MAX);
+
+        //All numbers of shard are in one flat array, so shards are summed by one loop. These are offsets of groups in it.
+        const int counterBase = 0;
+        const int commandBase = counterBase + counterCount;
+        const int replyBase = commandBase + commandCount;
+        const int errorBase = replyBase + replyCount;
+        const int bucketBase = errorBase + errorCount;
+        const int sumBase = bucketBase + histogramCount * Metrics::BucketCount;
+        const int valueCount = sumBase + histogramCount;
+
+        //Names of labels in report, in order of enums
+        const char* const commandNames[] = {"unknown", "move_by", "move_to_zero", "get_position", "subscribe",
+                                            "unsubscribe", "stop", "retarget", "move_to", "trajectory"};
+        const char* const replyNames[] = {"init", "received", "position", "success", "error", "telemetry", "halted",
+                                          "waypoint_reached", "other"};
+        const char* const errorNames[] = {"unknown_message", "lower_than_zero", "too_high", "already_moving",
+                                          "queue_full", "cancelled"};
+        static_assert(sizeof(commandNames) / sizeof(commandNames[0]) == commandCount, "Every message type needs name");
+        static_assert(sizeof(replyNames) / sizeof(replyNames[0]) == replyCount, "Every reply kind needs name");
+        static_assert(sizeof(errorNames) / sizeof(errorNames[0]) == errorCount, "Every AVR error needs name");
+
+        //Numbers of one thread. They are atomic only because report is read by another thread,
+        //the owner thread is the only writer, so it doesn't need atomic read-modify-write.
+        struct Shard
+        {
+            std::atomic<quint64> values[valueCount];
+            char padding[64];   //Next allocation of another thread doesn't share cache line with the last values
+
+            Shard()
+            {
+                for(std::atomic<quint64>& value : values)
+                    value.store(0, std::memory_order_relaxed);
+            }
+        };
+
+        struct Registry
+        {
+            QMutex mutex;               //Guards members below. It's taken only when thread starts or ends and by report.
+            QVector<Shard*> shards;     //Shards of running threads
+            quint64 retired[valueCount];    //Sum of shards of finished threads
+
+            Registry()
+            {
+                std::fill(retired, retired + valueCount, 0);
+            }
+        };
+
+        Registry& GetRegistry()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        //Shard of current thread. It's created at first record and added to totals when thread ends.
+        class LocalShard
+        {
+        private:
+            Shard* m_pShard = nullptr;
+
+        public:
+            ~LocalShard()
+            {
+                if(!m_pShard)
+                    return;
+                Registry& registry = GetRegistry();
+                QMutexLocker locker(&registry.mutex);
+                for(int i = 0; i < valueCount; i++)
+                    registry.retired[i] += m_pShard->values[i].load(std::memory_order_relaxed);
+                registry.shards.removeOne(m_pShard);
+                delete m_pShard;
+            }
+
+            Shard& Get()
+            {
+                if(!m_pShard)
+                {
+                    m_pShard = new Shard;
+                    Registry& registry = GetRegistry();
+                    QMutexLocker locker(&registry.mutex);
+                    registry.shards.append(m_pShard);
+                }
+                return *m_pShard;
+            }
+        };
+
+        thread_local LocalShard localShard;
+
+        inline void Increase(int index, quint64 value)
+        {
+            std::atomic<quint64>& item = localShard.Get().values[index];
+            item.store(item.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        int BucketOf(qint64 value)
+        {
+            if(value <= 0)
+                return 0;
+            return qMin(64 - int(qCountLeadingZeroBits(quint64(value))), Metrics::BucketCount - 1);
+        }
+    }
+
+    void Metrics::Add(Counter counter, quint64 value)
+    {
+        Increase(counterBase + int(counter), value);
+    }
+
+    void Metrics::CountCommand(Message::Type type)
+    {
+        int index = int(type);
+        if(index < 0 || index >= commandCount)  //Client may send any code, all unknown ones are counted together
+            index = int(Message::Type::Unknown);
+        Increase(commandBase + index, 1);
+    }
+
+    void Metrics::CountReply(Reply reply)
+    {
+        Increase(replyBase + int(reply), 1);
+    }
+
+    void Metrics::CountReply(Protocol::Opcode opcode)
+    {
+        int index = int(opcode) - int(Protocol::Opcode::Init);
+        if(index < 0 || index >= int(Reply::Other))
+            index = int(Reply::Other);
+        Increase(replyBase + index, 1);
+    }
+
+    void Metrics::CountError(AVRSystem::Error code)
+    {
+        int index = int(code);
+        if(index >= 0 && index < errorCount)
+            Increase(errorBase + index, 1);
+    }
+
+    void Metrics::Record(Histogram histogram, qint64 value)
+    {
+        Increase(bucketBase + int(histogram) * BucketCount + BucketOf(value), 1);
+        Increase(sumBase + int(histogram), quint64(qMax<qint64>(value, 0)));
+    }
+
+    QString Metrics::Report(const Gauges& gauges)
+    {
+        quint64 values[valueCount];
+        {
+            Registry& registry = GetRegistry();
+            QMutexLocker locker(&registry.mutex);
+            std::copy(registry.retired, registry.retired + valueCount, values);
+            for(Shard* shard : registry.shards)
+            {
+                for(int i = 0; i < valueCount; i++)
+                    values[i] += shard->values[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        QString report;
+        auto family = [&](const char* name, const char* type)
+        {
+            report += QStringLiteral("# TYPE %1 %2\n").arg(QLatin1String(name), QLatin1String(type));
+        };
+        auto value = [&](const char* name, quint64 number)
+        {
+            report += QStringLiteral("%1 %2\n").arg(QLatin1String(name)).arg(number);
+        };
+        auto labeled = [&](const char* name, const char* label, const char* labelValue, quint64 number)
+        {
+            report += QStringLiteral("%1{%2=\"%3\"} %4\n").arg(QLatin1String(name), QLatin1String(label),
+                                                              QLatin1String(labelValue)).arg(number);
+        };
+
+        family("avr_received_bytes_total", "counter");
+        value("avr_received_bytes_total", values[counterBase + int(Counter::BytesIn)]);
+        family("avr_sent_bytes_total", "counter");
+        value("avr_sent_bytes_total", values[counterBase + int(Counter::BytesOut)]);
+        family("avr_connections_total", "counter");
+        labeled("avr_connections_total", "role", "controller", values[counterBase + int(Counter::Controllers)]);
+        labeled("avr_connections_total", "role", "observer", values[counterBase + int(Counter::Observers)]);
+        family("avr_dropped_observers_total", "counter");
+        value("avr_dropped_observers_total", values[counterBase + int(Counter::DroppedObservers)]);
+        family("avr_rejected_commands_total", "counter");
+        value("avr_rejected_commands_total", values[counterBase + int(Counter::RejectedCommands)]);
+
+        family("avr_commands_total", "counter");
+        for(int i = 0; i < commandCount; i++)
+            labeled("avr_commands_total", "type", commandNames[i], values[commandBase + i]);
+        family("avr_replies_total", "counter");
+        for(int i = 0; i < replyCount; i++)
+            labeled("avr_replies_total", "type", replyNames[i], values[replyBase + i]);
+        family("avr_errors_total", "counter");
+        for(int i = 0; i < errorCount; i++)
+            labeled("avr_errors_total", "error", errorNames[i], values[errorBase + i]);
+
+        family("avr_devices", "gauge");
+        value("avr_devices", quint64(gauges.devices));
+        family("avr_queue_depth", "gauge");
+        value("avr_queue_depth", quint64(gauges.queueDepth));
+        family("avr_queue_peak_depth", "gauge");
+        value("avr_queue_peak_depth", quint64(gauges.queuePeak));
+        family("avr_queue_capacity", "gauge");
+        value("avr_queue_capacity", quint64(gauges.queueCapacity));
+
+        const char* const histogramNames[] = {"avr_move_duration_ms", "avr_reply_latency_us"};
+        for(int h = 0; h < histogramCount; h++)
+        {
+            QString name = QLatin1String(histogramNames[h]);
+            report += QStringLiteral("# TYPE %1 histogram\n").arg(name);
+            quint64 count = 0;  //Buckets of Prometheus histogram are cumulative
+            for(int i = 0; i < BucketCount; i++)
+            {
+                count += values[bucketBase + h * BucketCount + i];
+                QString bound = i < BucketCount - 1 ? QString::number((quint64(1) << i) - 1) : QStringLiteral("+Inf");
+                report += QStringLiteral("%1_bucket{le=\"%2\"} %3\n").arg(name, bound).arg(count);
+            }
+            report += QStringLiteral("%1_sum %2\n").arg(name).arg(values[sumBase + h]);
+            report += QStringLiteral("%1_count %2\n").arg(name).arg(count);
+        }
+        return report;
+    }
+}
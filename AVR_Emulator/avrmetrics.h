@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QtGlobal>
+#include <QString>
+#include "avrmessage.h"
+#include "avrsystem.h"
+#include "avrprotocol.h"
+
+namespace AVR
+{
+    //Runtime numbers of the whole emulator process: traffic of servers, errors, move durations and reply latencies.
+    //Every thread records into its own shard of counters. Only this thread writes the shard, so recording is
+    //one relaxed atomic store without locks, and threads never write the same cache lines.
+    //Shards are summed only when report is asked (by \q query of client or by metrics endpoint).
+    //Shard of finished thread is added to totals, so numbers never go back.
+    class Metrics
+    {
+    public:
+        enum class Counter
+        {
+            BytesIn,            //Bytes read from clients' sockets
+            BytesOut,           //Bytes written to clients' sockets
+            Controllers,        //Connections which became controlling clients
+            Observers,          //Connections which became read-only observers
+            DroppedObservers,   //Observers disconnected because they didn't read their data
+            RejectedCommands,   //Commands answered by error without execution (observer's orders, wrong device
+                                //or trajectory, full command queue)
+            COUNTER_MAX
+        };
+
+        enum class Reply    //Messages sent to clients. First ones go in order of binary protocol opcodes.
+        {
+            Init,
+            Received,
+            Position,
+            Success,
+            Error,
+            Telemetry,
+            Halted,
+            WaypointReached,
+            Other,          //Text messages, protocol version answers, observer notices, metrics reports
+            REPLY_MAX
+        };
+
+        enum class Histogram
+        {
+            MoveDuration,   //Simulated duration of every move (or trajectory segment) in milliseconds
+            ReplyLatency,   //Time from reading command to its last reply in microseconds. Only commands with
+                            //request ID which went to AVR System are measured, position is answered by server at once.
+            HISTOGRAM_MAX
+        };
+
+        //Numbers which are read from devices when report is formed, they are not recorded
+        struct Gauges
+        {
+            int devices = 0;
+            int queueDepth = 0;     //Commands waiting in queues now
+            int queuePeak = 0;      //Largest depth which any queue has ever had
+            int queueCapacity = 0;
+        };
+
+        //Histogram bucket i counts values from 2^(i-1) to 2^i - 1, bucket 0 counts zeros, the last one counts the rest
+        static const int BucketCount = 32;
+
+        static void Add(Counter counter, quint64 value = 1);
+        static void CountCommand(Message::Type type);       //Command received from client
+        static void CountReply(Reply reply);                //Message written to output buffer of one client
+        static void CountReply(Protocol::Opcode opcode);    //Same for server's binary opcodes
+        static void CountError(AVRSystem::Error code);
+        static void Record(Histogram histogram, qint64 value);
+
+        //Returns all numbers in Prometheus text format. Gauges are given by caller.
+        static QString Report(const Gauges& gauges);
+    };
+}
@@ -0,0 +1,96 @@
+#include "avrmetricsserver.h"
+#include "avrtrace.h"
+#include <QBuffer>
+#include <stdexcept>
+
+namespace AVR
+{
+    namespace
+    {
+        const qint64 maxRequestSize = 8 * 1024;     //Scraper's request is a few short lines, anything larger is dropped
+    }
+
+    MetricsServer::MetricsServer(int nPort, QObject* parent)
+        : QObject(parent),
+          m_Server(this)
+    {
+        if(!m_Server.listen(QHostAddress::LocalHost, nPort))
+        {
+            QString error = "Unable to start the metrics server: " + m_Server.errorString();
+            m_Server.close();
+            throw std::runtime_error(error.toStdString());
+        }
+        QObject::connect(&m_Server, &QTcpServer::newConnection, this, &MetricsServer::slotNewConnection);
+    }
+
+    MetricsServer::~MetricsServer()
+    {
+        m_Server.close();   //Sockets of requests are children of QTcpServer, they are deleted together with it
+    }
+
+    void MetricsServer::SetDevices(const QVector<AVRSystem*>& devices)
+    {
+        m_Devices = devices;
+    }
+
+    Metrics::Gauges MetricsServer::GetGauges() const
+    {
+        Metrics::Gauges gauges;
+        gauges.devices = m_Devices.size();
+        for(AVRSystem* avr : m_Devices)
+        {
+            const CommandQueue* queue = avr->GetCommandQueue();    //Queue is thread-safe, AVR thread isn't disturbed
+            gauges.queueDepth += queue->Depth();
+            gauges.queuePeak = qMax(gauges.queuePeak, queue->MaxDepth());
+            gauges.queueCapacity += queue->Capacity();
+        }
+        return gauges;
+    }
+
+    void MetricsServer::slotNewConnection()
+    {
+        while(m_Server.hasPendingConnections())
+        {
+            QTcpSocket* socket = m_Server.nextPendingConnection();
+            QObject::connect(socket, &QTcpSocket::readyRead, this, &MetricsServer::slotReadRequest);
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+        }
+    }
+
+    void MetricsServer::slotReadRequest()
+    {
+        QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+        //Request is answered when its headers are over (empty line). Only path of request line matters.
+        QByteArray request = socket->peek(maxRequestSize);
+        if(!request.contains("\r\n\r\n") && !request.contains("\n\n"))
+        {
+            if(socket->bytesAvailable() >= maxRequestSize)
+                socket->abort();
+            return;
+        }
+        QList<QByteArray> requestLine = request.left(request.indexOf('\n')).trimmed().split(' ');
+        QByteArray path = requestLine.value(1);
+
+        QByteArray body, type;
+        if(path.startsWith("/trace"))   //Chrome trace recorded so far, if emulator was launched with -trace
+        {
+            QBuffer buffer(&body);
+            buffer.open(QIODevice::WriteOnly);
+            Trace::Write(buffer);
+            type = "application/json";
+        }
+        else    //Any other path gives metrics report
+        {
+            body = Metrics::Report(GetGauges()).toUtf8();
+            type = "text/plain; version=0.0.4";
+        }
+        //Connection is closed after answer, so scraper doesn't keep it
+        QByteArray response = "HTTP/1.0 200 OK\r\n"
+                              "Content-Type: " + type + "\r\n"
+                              "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                              "Connection: close\r\n\r\n";
+        socket->disconnect(this);   //The rest of request is ignored
+        socket->write(response + body);
+        socket->disconnectFromHost();
+    }
+}
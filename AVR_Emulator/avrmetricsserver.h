@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QVector>
+#include "avrsystem.h"
+#include "avrmetrics.h"
+
+namespace AVR
+{
+    //Local endpoint of emulator metrics. It listens only loopback interface and answers any HTTP request
+    //by current metrics report in Prometheus text format, so scraper (or curl) can poll it.
+    //Queue gauges are summed over all devices of host at the moment of request.
+    //Path /trace gives Chrome trace recorded so far instead (see avrtrace.h).
+    class MetricsServer : public QObject
+    {
+        Q_OBJECT
+
+    private:
+        QTcpServer m_Server;
+        QVector<AVRSystem*> m_Devices;  //Devices which queues are reported
+
+    public:
+        //Starts listening localhost port. Throws std::runtime_error if port can't be listened.
+        MetricsServer(int nPort, QObject* parent = 0);
+        ~MetricsServer();
+
+        void SetDevices(const QVector<AVRSystem*>& devices);
+        Metrics::Gauges GetGauges() const;  //Reads queue gauges of all devices
+
+    private slots:
+        void slotNewConnection();
+        void slotReadRequest();     //Answers request when its headers are over
+    };
+}
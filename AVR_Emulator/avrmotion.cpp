@@ -0,0 +1,338 @@
+#include "avrmotion.h"
+#include <algorithm>
+#include <vector>
+#include <cmath>
+
+namespace AVR
+{
+    namespace
+    {
+        const int initialWaitTime = 1000;     // Initial pause in milliseconds between moving iterations.
+        const int minumumWaitTime = 5;        // Wait time will be decreased on every iteration until
+                                              // it will reach minumumWaitTime value.
+        const float timeDecreaseFactor = 0.90f;   //This is factor of waitTime decrease per iteration.
+
+        //Profiles with deceleration have the same top speed as geometric ramp (one step per minumumWaitTime)
+        //and reach it in about 50 steps too, but they start much faster and stop smoothly at goal.
+        const double topSpeed = 1.0 / minumumWaitTime;  //Steps per millisecond
+        const double acceleration = 0.0004;             //Steps per millisecond squared (peak value for S-curve)
+        const double pi = 3.14159265358979323846;
+
+        //Times of steps made while pause is still decreasing. After the last one pauses are always minumumWaitTime.
+        //Pause values are truncated to whole milliseconds on every iteration exactly as real AVR timer does,
+        //so this ramp can't be expressed by geometric series formula. But it's short (less than 50 steps).
+        const std::vector<qint64>& RampStepTimes()
+        {
+            static const std::vector<qint64> times = []()
+            {
+                std::vector<qint64> result;
+                qint64 time = 0;
+                int waitTime = initialWaitTime;
+                result.push_back(time);     //Step 0 is made instantly
+                while(true)
+                {
+                    //Decreasing wait time
+                    if(waitTime > minumumWaitTime)
+                        waitTime *= timeDecreaseFactor;
+                    else if(waitTime < minumumWaitTime) //If time is lower than minimum value
+                        waitTime = minumumWaitTime;     //than it equals minimum value.
+
+                    time += waitTime;
+                    if(waitTime == minumumWaitTime)     //Ramp is over, last value is first step on the floor
+                    {
+                        result.push_back(time);
+                        break;
+                    }
+                    result.push_back(time);
+                }
+                return result;
+            }();
+            return times;
+        }
+
+        //Speed ramp of S-curve profile: speed grows from 0 to peakSpeed by half of cosine wave in rampTime.
+        //Returns distance made in elapsed time since the ramp start.
+        double SineRampPosition(double elapsed, double peakSpeed, double rampTime)
+        {
+            return peakSpeed / 2 * (elapsed - rampTime / pi * std::sin(pi * elapsed / rampTime));
+        }
+
+        //Inverse of SineRampPosition(). It has no closed form, but it's monotonic, so bisection finds it.
+        double SineRampTime(double position, double peakSpeed, double rampTime)
+        {
+            double from = 0, to = rampTime;
+            for(int i = 0; i < 40; i++)     //Error is far below a millisecond after it
+            {
+                double middle = (from + to) / 2;
+                if(SineRampPosition(middle, peakSpeed, rampTime) < position)
+                    from = middle;
+                else
+                    to = middle;
+            }
+            return to;
+        }
+
+        //Shape of move with symmetric acceleration and deceleration: how long AVR accelerates and how fast it goes.
+        //Short moves don't reach top speed, they decelerate right after acceleration.
+        struct Shape
+        {
+            double rampTime;    //Duration of acceleration (and of deceleration)
+            double rampSteps;   //Distance made while accelerating
+            double peakSpeed;   //Speed between ramps
+            double cruiseTime;  //Duration of move with peak speed
+        };
+
+        Shape TrapezoidalShape(int distance)
+        {
+            Shape shape;
+            shape.rampSteps = topSpeed * topSpeed / (2 * acceleration);
+            if(2 * shape.rampSteps > distance)  //Triangle: AVR starts to decelerate in the middle
+                shape.rampSteps = distance / 2.0;
+            shape.rampTime = std::sqrt(2 * shape.rampSteps / acceleration);
+            shape.peakSpeed = acceleration * shape.rampTime;
+            shape.cruiseTime = (distance - 2 * shape.rampSteps) / topSpeed;
+            return shape;
+        }
+
+        Shape SCurveShape(int distance)
+        {
+            //Peak acceleration of sine ramp is peakSpeed * pi / (2 * rampTime), it equals acceleration of trapezoid
+            Shape shape;
+            shape.peakSpeed = topSpeed;
+            shape.rampTime = topSpeed * pi / (2 * acceleration);
+            shape.rampSteps = topSpeed * shape.rampTime / 2;
+            if(2 * shape.rampSteps > distance)  //Short move with lower peak speed and the same peak acceleration
+            {
+                shape.rampSteps = distance / 2.0;
+                shape.rampTime = std::sqrt(distance * pi / (2 * acceleration));
+                shape.peakSpeed = distance / shape.rampTime;
+            }
+            shape.cruiseTime = (distance - 2 * shape.rampSteps) / shape.peakSpeed;
+            return shape;
+        }
+    }
+
+    qint64 GeometricRamp::StepTime(int stepIndex, int /*distance*/)
+    {
+        const std::vector<qint64>& ramp = RampStepTimes();
+        int rampLast = int(ramp.size()) - 1;
+        if(stepIndex <= rampLast)
+            return ramp[stepIndex];
+        return ramp[rampLast] + qint64(stepIndex - rampLast) * minumumWaitTime;   //Flat part of profile
+    }
+
+    int GeometricRamp::StepsDoneIn(qint64 elapsed, int /*distance*/)
+    {
+        if(elapsed <= 0)
+            return 0;
+        const std::vector<qint64>& ramp = RampStepTimes();
+        int rampLast = int(ramp.size()) - 1;
+        if(elapsed >= ramp[rampLast])   //Flat part of profile
+            return int(rampLast + (elapsed - ramp[rampLast]) / minumumWaitTime);
+
+        //Last ramp step which time is not after elapsed
+        return int(std::upper_bound(ramp.begin(), ramp.end(), elapsed) - ramp.begin()) - 1;
+    }
+
+    qint64 GeometricRamp::Duration(int distance)
+    {
+        return StepTime(distance + 1, distance);    //Move is complete after the pause which follows the goal step
+    }
+
+    //Step time is rounded up to whole milliseconds, so step is made at the first millisecond when position reaches it.
+    template<typename Derived>
+    qint64 ContinuousProfile<Derived>::StepTime(int stepIndex, int distance)
+    {
+        if(stepIndex <= 0 || distance <= 0)
+            return 0;
+        return qint64(std::ceil(Derived::TimeOf(qMin(stepIndex, distance), distance)));
+    }
+
+    template<typename Derived>
+    int ContinuousProfile<Derived>::StepsDoneIn(qint64 elapsed, int distance)
+    {
+        if(elapsed <= 0 || distance <= 0)
+            return 0;
+        int steps = qBound(0, int(std::floor(Derived::PositionAfter(double(elapsed), distance))), distance);
+        //Floating point could be a bit off at step boundaries, StepTime() is the reference
+        while(steps < distance && StepTime(steps + 1, distance) <= elapsed)
+            steps++;
+        while(steps > 0 && StepTime(steps, distance) > elapsed)
+            steps--;
+        return steps;
+    }
+
+    template<typename Derived>
+    qint64 ContinuousProfile<Derived>::Duration(int distance)
+    {
+        return StepTime(distance, distance);    //AVR stops right at the goal step
+    }
+
+    double Trapezoidal::PositionAfter(double elapsed, int distance)
+    {
+        Shape shape = TrapezoidalShape(distance);
+        double total = 2 * shape.rampTime + shape.cruiseTime;
+        if(elapsed >= total)
+            return distance;
+        if(elapsed <= shape.rampTime)   //Accelerating
+            return acceleration * elapsed * elapsed / 2;
+        if(elapsed <= shape.rampTime + shape.cruiseTime)    //Cruising
+            return shape.rampSteps + shape.peakSpeed * (elapsed - shape.rampTime);
+        double left = total - elapsed;  //Decelerating, it's acceleration played backwards
+        return distance - acceleration * left * left / 2;
+    }
+
+    double Trapezoidal::TimeOf(double position, int distance)
+    {
+        Shape shape = TrapezoidalShape(distance);
+        if(position <= shape.rampSteps)
+            return std::sqrt(2 * position / acceleration);
+        if(position <= distance - shape.rampSteps)
+            return shape.rampTime + (position - shape.rampSteps) / shape.peakSpeed;
+        return 2 * shape.rampTime + shape.cruiseTime - std::sqrt(2 * (distance - position) / acceleration);
+    }
+
+    double SCurve::PositionAfter(double elapsed, int distance)
+    {
+        Shape shape = SCurveShape(distance);
+        double total = 2 * shape.rampTime + shape.cruiseTime;
+        if(elapsed >= total)
+            return distance;
+        if(elapsed <= shape.rampTime)
+            return SineRampPosition(elapsed, shape.peakSpeed, shape.rampTime);
+        if(elapsed <= shape.rampTime + shape.cruiseTime)
+            return shape.rampSteps + shape.peakSpeed * (elapsed - shape.rampTime);
+        return distance - SineRampPosition(total - elapsed, shape.peakSpeed, shape.rampTime);
+    }
+
+    double SCurve::TimeOf(double position, int distance)
+    {
+        Shape shape = SCurveShape(distance);
+        if(position <= shape.rampSteps)
+            return SineRampTime(position, shape.peakSpeed, shape.rampTime);
+        if(position <= distance - shape.rampSteps)
+            return shape.rampTime + (position - shape.rampSteps) / shape.peakSpeed;
+        return 2 * shape.rampTime + shape.cruiseTime - SineRampTime(distance - position, shape.peakSpeed, shape.rampTime);
+    }
+
+    Motion::Motion()
+    {
+        m_iStartPosition = 0;
+        m_iGoalPosition = 0;
+        m_iStep = 1;
+        m_StartTime = 0;
+        m_Profile = MotionProfile::GeometricRamp;
+    }
+
+    Motion::Motion(int startPos, int goalPos, qint64 startTime, MotionProfile profile)
+    {
+        m_iStartPosition = startPos;
+        m_iGoalPosition = goalPos;
+        m_iStep = goalPos < startPos ? -1 : 1;
+        m_StartTime = startTime;
+        m_Profile = profile;
+    }
+
+    int Motion::GetStartPosition() const
+    {
+        return m_iStartPosition;
+    }
+
+    int Motion::GetGoalPosition() const
+    {
+        return m_iGoalPosition;
+    }
+
+    qint64 Motion::GetStartTime() const
+    {
+        return m_StartTime;
+    }
+
+    MotionProfile Motion::GetProfile() const
+    {
+        return m_Profile;
+    }
+
+    int Motion::Distance() const
+    {
+        return (m_iGoalPosition - m_iStartPosition) * m_iStep;
+    }
+
+    template<typename Profile>
+    int Motion::StepsDoneIn(qint64 elapsed) const
+    {
+        return Profile::StepsDoneIn(elapsed, Distance());
+    }
+
+    template<typename Profile>
+    qint64 Motion::StepTime(int stepIndex) const
+    {
+        return Profile::StepTime(stepIndex, Distance());
+    }
+
+    template<typename Profile>
+    qint64 Motion::Duration() const
+    {
+        return Profile::Duration(Distance());
+    }
+
+    template<typename Profile>
+    qint64 Motion::NextStepTimeFor(qint64 time) const
+    {
+        int nextStep = StepsDoneIn<Profile>(time - m_StartTime) + 1;
+        if(nextStep > Distance())   //Only finish is left
+            return m_StartTime + Duration<Profile>();
+        return m_StartTime + StepTime<Profile>(nextStep);
+    }
+
+    //Profile is checked once per call, everything below it is specialized for the profile.
+    int Motion::PositionAt(qint64 time) const
+    {
+        int steps;
+        switch(m_Profile)
+        {
+            case MotionProfile::Trapezoidal:
+                steps = StepsDoneIn<Trapezoidal>(time - m_StartTime);
+                break;
+            case MotionProfile::SCurve:
+                steps = StepsDoneIn<SCurve>(time - m_StartTime);
+                break;
+            default:
+                steps = StepsDoneIn<GeometricRamp>(time - m_StartTime);
+        }
+        if(steps > Distance())
+            steps = Distance();
+        return m_iStartPosition + steps * m_iStep;
+    }
+
+    qint64 Motion::FinishTime() const
+    {
+        switch(m_Profile)
+        {
+            case MotionProfile::Trapezoidal:
+                return m_StartTime + Duration<Trapezoidal>();
+            case MotionProfile::SCurve:
+                return m_StartTime + Duration<SCurve>();
+            default:
+                return m_StartTime + Duration<GeometricRamp>();
+        }
+    }
+
+    bool Motion::IsFinishedAt(qint64 time) const
+    {
+        return time >= FinishTime();
+    }
+
+    qint64 Motion::NextStepTime(qint64 time) const
+    {
+        switch(m_Profile)
+        {
+            case MotionProfile::Trapezoidal:
+                return NextStepTimeFor<Trapezoidal>(time);
+            case MotionProfile::SCurve:
+                return NextStepTimeFor<SCurve>(time);
+            default:
+                return NextStepTimeFor<GeometricRamp>(time);
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QtGlobal>
+
+namespace AVR
+{
+    enum class MotionProfile    //Acceleration profile of AVR moves. It's chosen for every device at startup.
+    {
+        GeometricRamp,  //Original AVR timing: every pause is 0.90 of previous one down to 5 ms floor, no deceleration
+        Trapezoidal,    //Constant acceleration up to top speed, cruise and symmetric constant deceleration
+        SCurve          //Like trapezoidal, but acceleration grows and falls smoothly (sine shaped speed ramps)
+    };
+
+    //Acceleration profiles are policies with static methods, so Motion is specialized for each of them at compile time
+    //and position requests don't pay for virtual calls. distance is step count of the whole move.
+    //Step 0 is start position itself, it's made instantly.
+    struct GeometricRamp
+    {
+        static qint64 StepTime(int stepIndex, int distance);    //Returns time passed from start until step is made
+        static int StepsDoneIn(qint64 elapsed, int distance);   //Returns index of last step made in elapsed time
+        static qint64 Duration(int distance);   //Returns time of the whole move, AVR is standing at goal after it
+    };
+
+    //Profiles with deceleration are described by continuous position function. Step is made when position reaches
+    //its index, and move is over when AVR stops at goal. Derived profile gives PositionAfter() and TimeOf().
+    template<typename Derived>
+    struct ContinuousProfile
+    {
+        static qint64 StepTime(int stepIndex, int distance);
+        static int StepsDoneIn(qint64 elapsed, int distance);
+        static qint64 Duration(int distance);
+    };
+
+    struct Trapezoidal : ContinuousProfile<Trapezoidal>
+    {
+        static double PositionAfter(double elapsed, int distance);  //Exact position, fraction means step is in progress
+        static double TimeOf(double position, int distance);        //Inverse of PositionAfter()
+    };
+
+    struct SCurve : ContinuousProfile<SCurve>
+    {
+        static double PositionAfter(double elapsed, int distance);
+        static double TimeOf(double position, int distance);
+    };
+
+    //Motion model of one AVR move. It knows where AVR is at any moment of the move without walking it step by step.
+    //All times are in milliseconds of the clock which was used for start time.
+    class Motion
+    {
+    private:
+        int m_iStartPosition;   //Position where move was started
+        int m_iGoalPosition;    //Position where move ends
+        int m_iStep;            //Move direction. 1 if moving forward, -1 if moving backward.
+        qint64 m_StartTime;     //Moment when move was started
+        MotionProfile m_Profile;    //Acceleration profile of the move
+
+        int Distance() const;   //Returns step count of the move
+        template<typename Profile> int StepsDoneIn(qint64 elapsed) const;
+        template<typename Profile> qint64 StepTime(int stepIndex) const;
+        template<typename Profile> qint64 Duration() const;
+        template<typename Profile> qint64 NextStepTimeFor(qint64 time) const;
+
+    public:
+        Motion();
+        Motion(int startPos, int goalPos, qint64 startTime, MotionProfile profile = MotionProfile::GeometricRamp);
+
+        int GetStartPosition() const;
+        int GetGoalPosition() const;
+        qint64 GetStartTime() const;
+        MotionProfile GetProfile() const;
+        int PositionAt(qint64 time) const;      //Returns exact position at certain moment. Constant time.
+        qint64 FinishTime() const;              //Returns moment when move will be complete
+        bool IsFinishedAt(qint64 time) const;   //Checks whether move is complete at certain moment
+        qint64 NextStepTime(qint64 time) const; //Returns moment of the first step made after certain moment.
+                                                //After the goal step it's finish time.
+    };
+}
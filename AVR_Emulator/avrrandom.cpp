@@ -0,0 +1,54 @@
+#include "avrrandom.h"
+#include <chrono>
+#include <random>
+
+namespace AVR
+{
+    namespace
+    {
+        const quint64 goldenGamma = 0x9E3779B97F4A7C15ULL;  //Counter increment of SplitMix64
+    }
+
+    Random::Random()
+        : m_State(RandomSeed())
+    {
+    }
+
+    Random::Random(quint64 seed)
+        : m_State(seed)
+    {
+    }
+
+    void Random::Seed(quint64 seed)
+    {
+        m_State.store(seed, std::memory_order_relaxed);
+    }
+
+    quint64 Random::Next()
+    {
+        //Every caller gets its own counter value, so concurrent calls never get the same number
+        return Mix(m_State.fetch_add(goldenGamma, std::memory_order_relaxed) + goldenGamma);
+    }
+
+    int Random::Between(int min, int max)
+    {
+        quint64 range = quint64(qint64(max) - min + 1);
+        return int(qint64(min) + qint64(((Next() >> 32) * range) >> 32));  //Multiply-shift instead of slow modulo
+    }
+
+    quint64 Random::Mix(quint64 value)
+    {
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
+
+    quint64 Random::RandomSeed()
+    {
+        static std::atomic<quint64> counter(0);     //Generators created at the same moment still get different seeds
+        std::random_device device;
+        quint64 seed = (quint64(device()) << 32) ^ device();
+        seed ^= quint64(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+        return Mix(seed + counter.fetch_add(goldenGamma, std::memory_order_relaxed));
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QtGlobal>
+#include <atomic>
+
+namespace AVR
+{
+    //Fast pseudo-random generator of one AVR device (SplitMix64).
+    //Its whole state is one counter which is advanced by atomic addition, so any thread can take numbers
+    //without locks, and devices with different seeds never share anything.
+    class Random
+    {
+    private:
+        std::atomic<quint64> m_State;   //Counter which is mixed into output numbers
+
+        //Disallow copying
+        Random(const Random&) = delete;
+        Random& operator=(const Random&) = delete;
+
+    public:
+        Random();               //Seeds generator by unpredictable value
+        explicit Random(quint64 seed);
+
+        void Seed(quint64 seed);    //Restarts sequence. Generator with the same seed gives the same numbers.
+        quint64 Next();             //Returns next 64-bit number. Thread-safe and lock-free.
+        int Between(int min, int max);  //Returns number in range [min, max]
+
+        static quint64 Mix(quint64 value);  //SplitMix64 finalizer. Spreads close values (e.g. seed + device index) apart.
+        static quint64 RandomSeed();        //Returns unpredictable seed, different for every call
+    };
+}
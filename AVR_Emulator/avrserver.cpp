@@ -1,6 +1,7 @@
 #include "avrserver.h"
-#include <QMessageBox>
+#include <QTimer>
 #include <stdexcept>
+#include <algorithm>
 
 /*
     Server messages for it's client always must contain special token at the begining.
@@ -43,60 +44,185 @@
              1 - equals AVR::Message::Type::MoveForNSteps
              2 - equals AVR::Message::Type::MoveToZero
              3 - equals AVR::Message::Type::GetPosition
+             4 - equals AVR::Message::Type::Subscribe (step count is interval of position updates in milliseconds)
+             5 - equals AVR::Message::Type::Unsubscribe
+             6 - equals AVR::Message::Type::Stop
+             7 - equals AVR::Message::Type::Retarget (step count is new goal position)
+             8 - equals AVR::Message::Type::MoveTo (step count is goal position)
+             9 - equals AVR::Message::Type::Trajectory (step count is waypoint count)
 
 
     \s - means AVR reporting about successfuly finished move operation. Does not contain anything after token.
          All data after \s will be ignored. It just notifies client about successfuly finished moving.
 
          Format:    \s
+
+
+    \w - means AVR reached waypoint of trajectory. Trajectory is sent by client as one command with list of positions:
+         9:<Waypoint>,<Waypoint>,...  (from 1 to 1024 waypoints, e.g. 9:100,5000,0#12). AVR moves to every waypoint
+         one by one (stopping at each of them), and client gets \w for every waypoint with trajectory's request ID.
+         After the last \w client gets \s. If any waypoint is out of range, trajectory isn't started at all.
+         Message example:      \w1:5000#12    Waypoint with index 1 (the second one) at position 5000 was reached.
+
+         Format:    \w<WaypointIndex>:<Position>
+
+
+    \h - means move was interrupted before it reached its goal, and AVR is at position which comes after token now.
+         This position is ALWAYS true. It's the last reply to order which started the move (instead of \s).
+         Stop order (6) halts current move: client gets \r6, \h for current move, errors for all move orders
+         which were waiting in queue (they are cancelled), and \s for Stop itself.
+         Retarget order (7) changes goal of current move: client gets \h for current move and \r7:<Goal>,
+         then AVR goes on to new goal and \s comes for Retarget order. Idle AVR just moves to new goal.
+         Message example:      \h1200#17    Move ordered by request 17 was stopped at position 1200.
+
+         Format:    \h<PositionNumber>
+
+
+    \t - means position update for client which subscribed for them by Subscribe message (e.g. 4:100 - every 100 ms,
+         or 4:0 - on every step). First update with current position comes right after \r4, next ones come while
+         AVR is moving, and the last one is final position which comes before \s. Unsubscribe message (5) stops them.
+         Like \p this position may be untrue with some random probability. Updates are not replies, they never have
+         request ID.
+
+         Format:    \t<PositionNumber>
+
+
+    \o - means this connection is read-only observer, because AVR System already has controlling client.
+         Observer gets all replies and position updates sent to controller, but without controller's request IDs,
+         so they can't be mistaken for replies to observer's own requests.
+         It can ask AVR position (reply goes only to this observer), all other orders are rejected with error.
+         Observer stays observer even if controller disconnects, next connected client will control AVR.
+         This message comes right after connection, before \i.
+
+         Format:    \o
+
+
+    \v - means answer to client's request of protocol version (client sends \v<Version> too).
+         \v2 means server switches this connection to binary protocol (see avrprotocol.h) right after this message.
+         Device ID which must be used in binary records comes after version.
+         \v1 means connection stays on text protocol (if client asked for it or requested version isn't supported).
+         Both answers mean server supports request IDs. Servers without them answered just \v1.
+         Message example:      \v2:0    Binary protocol is on, device ID is 0.
+
+         Format:    \v<Version>:<DeviceID>
+
+
+    \q - means answer to client's \q query of metrics. Report of the whole emulator process in Prometheus text format
+         comes after token: counters of commands, replies, errors and traffic, queue gauges of this device,
+         histograms of move durations and reply latencies. Any client may ask it, observer too.
+         Only text protocol connections can ask it, scrapers can use local metrics endpoint (-metrics <port>) instead.
+
+         Format:    \q<Report>
+
+
+    Request IDs. Client may end any command with #<RequestID>, e.g. 1:56#17 or 3#18.
+    Replies to this command (\r, \p, \s and \m with error) end with the same ID,
+    so client doesn't have to wait for reply before sending next command.
+    Replies come in order of execution: e.g. position request sent while AVR is moving
+    is answered at once, before \r and \s of move orders queued before it.
+    Message examples:      \r1:56#17    \p1200#18    \s#17    \mAVR Error: Requested position is lower than 0.#19
+
+    Replies to commands without request ID don't have it, so old clients see the same messages as before.
+
+    Command queue. Commands wait for execution in bounded queue (-queue, 64 by default). When it's full server
+    either stops reading client's commands until AVR executes some of them (-overload block, default), or rejects them
+    at once with "\mAVR Error: AVR is busy, command queue is full." message (-overload reject).
 */
 
+namespace
+{
+    const qint64 maxObserverBacklog = 1024 * 1024;  //Observer which doesn't read so much data is disconnected,
+                                                    //so slow observer can't eat server memory
+    const int flushThreshold = 16 * 1024;   //Output buffer of such size is written at once, without waiting for event loop
+    const qint64 readBufferSize = 64 * 1024;    //Socket doesn't read more from network while so much data is unread,
+                                                //so client which is not read is slowed down by TCP flow control
+}
+
 AVR::Server::Server(const QHostAddress& host, int nPort, QObject* pwgt /*=0*/) : QObject(pwgt)
     ,m_ptcpServer(this)
 {
     if (!m_ptcpServer.listen(host, nPort)) //Starting listening port for certain host
     {
         //Well, server listen has been failed...
-        //Show error message and stop the server
-        QMessageBox::critical(0,"Server Error","Unable to start the server: " + m_ptcpServer.errorString());
+        //Stop the server and pass error message to the caller, it knows how to show it
+        QString error = "Unable to start the server: " + m_ptcpServer.errorString();
         m_ptcpServer.close();
-        throw std::runtime_error("Server listen failed.");
+        throw std::runtime_error(error.toStdString());
     }
     //Connect new connection signal with server's slot
     QObject::connect(&m_ptcpServer, &QTcpServer::newConnection, this, &Server::slotNewConnection);
-    m_theOnlyClient = nullptr;
-    m_bHasClient = false;
-    m_nNextBlockSize = 0;
+    m_pController = nullptr;
+    m_pAVR = nullptr;
+    m_pQueue = nullptr;
+    m_OverloadPolicy = CommandQueue::OverloadPolicy::Block;
+    m_iDeviceId = 0;
+    m_Uptime.start();
 }
 
 AVR::Server::~Server()
 {
-    //Stop server, clean-up data
-    if(m_bHasClient)
-        m_theOnlyClient->close();
-    m_theOnlyClient->deleteLater();
+    //Stop server, clean-up data. Client sockets are children of QTcpServer, they are deleted together with it.
+    for(QTcpSocket* socket : m_Sessions.keys())
+    {
+        socket->disconnect(this);   //Server is being destroyed, it doesn't need disconnected signal
+        socket->close();
+    }
+    m_Sessions.clear();
     m_ptcpServer.close();
 }
 
+void AVR::Server::AttachAVR(const AVRSystem* avr)
+{
+    m_pAVR = avr;
+}
+
+void AVR::Server::SetDeviceId(quint16 id)
+{
+    m_iDeviceId = id;
+}
+
+void AVR::Server::AttachQueue(CommandQueue* queue, CommandQueue::OverloadPolicy policy)
+{
+    m_pQueue = queue;
+    m_OverloadPolicy = policy;
+}
+
 void AVR::Server::slotNewConnection()   //When new client connected
 {
-    if(m_bHasClient)    //If we already have a client...
-    {
-        //...kick him away and say him that he cannot connect now
-        auto newClient = m_ptcpServer.nextPendingConnection();
-        sendToClient(newClient, "\\mAVR System already has a client. Connection denied.");
-        newClient->close();
-    }
-    else    //If no client, server will accept new connection
+    while(m_ptcpServer.hasPendingConnections())
     {
-        //Save pointer to socket of new client and connect server's slot with it's read and disconnect signals
-        m_theOnlyClient = m_ptcpServer.nextPendingConnection();
-        QObject::connect(m_theOnlyClient, &QTcpSocket::disconnected, this, &AVR::Server::OnClientDisconnected);
-        QObject::connect(m_theOnlyClient, &QTcpSocket::readyRead, this, &Server::slotReadClient);
-        //Say client that he has been connected successfuly.
-        sendToClient(m_theOnlyClient, "\\mAVR Response: Connected successfuly!");
-        m_bHasClient = true;    //Now we have a client
-        emit ChangeConnectionLabel(true);   //Say UI to change connected lable state to Connected
+        //Save socket of new client and connect server's slot with it's read and disconnect signals
+        Session session;
+        session.socket = m_ptcpServer.nextPendingConnection();
+        session.nextBlockSize = 0;
+        session.binary = false;     //Every client starts with text protocol
+        session.observer = m_pController != nullptr;    //If we already have a controller new client only watches
+        session.waitsForInit = true;
+        session.outputPending = false;
+        session.trajectoryCount = 0;
+        session.trajectoryId = 0;
+        session.skippedPoints = 0;
+        session.skippedId = 0;
+        session.socket->setReadBufferSize(readBufferSize);
+        QObject::connect(session.socket, &QTcpSocket::disconnected, this, &AVR::Server::OnClientDisconnected);
+        QObject::connect(session.socket, &QTcpSocket::readyRead, this, &Server::slotReadClient);
+        Session& added = m_Sessions.insert(session.socket, session).value();
+
+        Metrics::Add(added.observer ? Metrics::Counter::Observers : Metrics::Counter::Controllers);
+        if(added.observer)
+        {
+            //Say client that he has been connected, but can only watch
+            sendToClient(added, "\\mAVR Response: Connected as observer. AVR System already has a controlling client.");
+            sendToClient(added, "\\o");
+            emit ObserverConnected(true);
+        }
+        else
+        {
+            //Say client that he has been connected successfuly.
+            sendToClient(added, "\\mAVR Response: Connected successfuly!");
+            m_pController = added.socket;       //Now we have a controller
+            emit ChangeConnectionLabel(true);   //Say UI to change connected lable state to Connected
+        }
         emit AskForClientInit();    //Ask AVR System to say server it's current position and max position
                                     //for sending it to client for it's initialization.
     }
@@ -106,109 +232,460 @@ void AVR::Server::slotReadClient()  //Read data when client sends to AVR somethi
 {
     //Get sender
     QTcpSocket* pClientSocket = (QTcpSocket*)sender();
-    QDataStream in(pClientSocket);  //Create data stream for sender's socket
-    in.setVersion(QDataStream::Qt_5_3); //Set version of data stream
+    auto it = m_Sessions.find(pClientSocket);
+    if(it == m_Sessions.end())
+        return;
+    ReadSession(it.value());
+}
+
+void AVR::Server::OnQueueHasSpace()
+{
+    //Controller's data left unread when queue was full. Socket won't say readyRead for it again.
+    if(m_pController)
+        ReadSession(m_Sessions[m_pController]);
+}
+
+void AVR::Server::ReadSession(Session& session)
+{
+    TraceScope trace("socket read");
+    //Sessions are not added or removed while reading, reference stays valid
+    QTcpSocket* pClientSocket = session.socket;
+    //While AVR's queue is full controller's commands stay in socket
+    bool mayBlock = m_pQueue && m_OverloadPolicy == CommandQueue::OverloadPolicy::Block && !session.observer;
+    uchar block[TextProtocol::MaxBlockSize];    //Incoming messages are parsed right in this buffer
+    quint64 received = 0;   //Bytes taken from socket, they are counted once for all messages
     while (true)    //Reading loop
     {
-        if (!m_nNextBlockSize)  //Break loop if nothing to read
+        if (mayBlock && m_pQueue->IsFull())
+            break;  //AVR System will say QueueHasSpace when it takes something
+        if (session.binary)  //Binary protocol: fixed-size records, decoded right from stack buffer
+        {
+            uchar record[Protocol::RecordSize];
+            if (pClientSocket->bytesAvailable() < Protocol::RecordSize)
+                break;
+            pClientSocket->read(reinterpret_cast<char*>(record), Protocol::RecordSize);
+            received += Protocol::RecordSize;
+            Protocol::Record decoded;
+            {
+                TraceScope decodeTrace("decode");
+                decoded = Protocol::Decode(record);
+                decodeTrace.SetRequestId(decoded.requestId);
+            }
+            HandleRecord(session, decoded);
+            continue;
+        }
+
+        if (!session.nextBlockSize)  //Break loop if nothing to read
         {
             if (pClientSocket->bytesAvailable() < qint64(sizeof(quint16)))
                 break;
-            in >> m_nNextBlockSize;
+            pClientSocket->read(reinterpret_cast<char*>(block), sizeof(quint16));
+            session.nextBlockSize = qFromBigEndian<quint16>(block);
+            received += sizeof(quint16);
         }
-        if (pClientSocket->bytesAvailable() < m_nNextBlockSize)
+        if (pClientSocket->bytesAvailable() < session.nextBlockSize)
             break;
-        QString incomingData;
-        in >> incomingData; //Save data to string
-        m_nNextBlockSize =0;
+
+        received += session.nextBlockSize;
+        TextProtocol::MessageView incomingData; //View of received string
+        if (session.nextBlockSize <= TextProtocol::MaxBlockSize)
+        {
+            pClientSocket->read(reinterpret_cast<char*>(block), session.nextBlockSize);
+            TextProtocol::MessageView::FromBlock(block, session.nextBlockSize, incomingData);
+        }
+        else    //No AVR message is so long. Skipping it, empty view will be reported as unknown message.
+        {
+            for (int left = session.nextBlockSize; left > 0; left -= TextProtocol::MaxBlockSize)
+                pClientSocket->read(reinterpret_cast<char*>(block), qMin(left, TextProtocol::MaxBlockSize));
+        }
+        session.nextBlockSize = 0;
+        if (incomingData.StartsWith('\\', 'v'))  //Client asks for protocol version
+        {
+            NegotiateProtocol(session, incomingData);
+            continue;   //Next data may be already binary
+        }
+        if (incomingData.StartsWith('\\', 'q'))  //Client asks for metrics
+        {
+            SendMetrics(session);
+            continue;
+        }
         //Received data now in format <ActionCode>:<StepCount>
-        //Forming AVR::Message instance
-        AVR::Message avrMsg = FormMessage(incomingData);
-        //Sending it to AVR System message queue
-        emit AVRMessage(avrMsg);
+        //Forming AVR::Message instance and passing it on
+        DispatchMessage(session, FormMessage(incomingData));
     }
+    if (received)
+        Metrics::Add(Metrics::Counter::BytesIn, received);
 }
 
-void AVR::Server::sendToClient(QTcpSocket* pSocket, const QString& str) //Sends data to client
+void AVR::Server::DispatchMessage(Session& session, const AVR::Message& msg)
 {
-    //Send string to client's socket by block array through data stream
-    QByteArray arrBlock;
-    QDataStream out(&arrBlock, QIODevice::WriteOnly);
-    out.setVersion(QDataStream::Qt_5_3);
-    out << quint16(0) << str;
-    out.device()->seek(0);
-    out << quint16(arrBlock.size() - sizeof(quint16));
-    pSocket->write(arrBlock);   //Writing block array to socket
+    Metrics::CountCommand(msg.GetMessageType());
+    if(session.observer)    //Observer's messages never go to AVR System
+        AnswerObserver(session, msg);
+    else if(msg.GetMessageType() == AVR::Message::Type::Trajectory && msg.GetWaypoints().isEmpty())
+        RejectTrajectory(session, msg.GetRequestId());  //No waypoints or too many of them
+    else if(msg.GetMessageType() == AVR::Message::Type::GetPosition && m_pAVR)
+    {
+        //Position is read from AVR System's snapshot right here, even if AVR is busy with long move
+        OnMessageReceived(AVR::Message::Type::GetPosition, 0, msg.GetRequestId());
+        SendPosition(m_pAVR->GetCurrentPos(), msg.GetRequestId());
+    }
+    else if(m_pQueue)   //Pushing it right to AVR System's command queue
+    {
+        bool notify = false;
+        if(msg.GetRequestId())
+            m_RequestTimes.insert(msg.GetRequestId(), m_Uptime.nsecsElapsed());
+        if(!m_pQueue->Push(msg, notify))
+        {
+            Metrics::Add(Metrics::Counter::RejectedCommands);
+            OnAVRError(AVRSystem::Error::QueueIsFull, msg.GetRequestId());   //Queue is full, AVR is too busy for it
+        }
+        else if(notify)
+            emit CommandsQueued();  //AVR System is woken up once for all commands pushed before it starts taking them
+    }
+    else    //Sending it to AVR System message queue
+    {
+        if(msg.GetRequestId())
+            m_RequestTimes.insert(msg.GetRequestId(), m_Uptime.nsecsElapsed());
+        emit AVRMessage(msg);
+    }
 }
 
-AVR::Message AVR::Server::FormMessage(const QString& str)   //Create AVR::Message from incoming client's message
+//Observer can only ask position. Replies to observer's requests go only to this observer.
+void AVR::Server::AnswerObserver(Session& session, const AVR::Message& msg)
 {
-    int delimiterPos = str.indexOf(":", 0); //Finding ':' delimiter position
-    if(delimiterPos != -1)
+    quint32 requestId = msg.GetRequestId();
+    if(msg.GetMessageType() != AVR::Message::Type::GetPosition || !m_pAVR)
     {
-        QString tmp;
-        int msg, pos;
-        tmp = str.left(delimiterPos);
-        msg = tmp.toInt();  //Saving message code
-        tmp = str.right(str.length() - (delimiterPos + 1));
-        pos = tmp.toInt();  //Saving position
-        return AVR::Message(AVR::Message::Type(msg), pos);  //Returning AVR::Message
+        Metrics::Add(Metrics::Counter::RejectedCommands);
+        if(session.binary)
+            sendRecord(session, Protocol::Opcode::Error, qint32(Protocol::ErrorCode::ReadOnlySession), 0, requestId);
+        else
+            sendToClient(session, WithRequestId(ErrorText(Protocol::ErrorCode::ReadOnlySession), requestId),
+                         Metrics::Reply::Error);
+        return;
     }
-    else    //Iff not found - just converting message to int and passing it to AVR::Message as message type
-        return AVR::Message(AVR::Message::Type(str.toInt()));
+
+    int pos = m_pAVR->GetCurrentPos();
+    if(session.binary)
+    {
+        sendRecord(session, Protocol::Opcode::Received, qint32(msg.GetMessageType()), 0, requestId);
+        sendRecord(session, Protocol::Opcode::Position, pos, 0, requestId);
+        return;
+    }
+    sendToClient(session, WithRequestId(ReceivedText(msg.GetMessageType(), 0), requestId), Metrics::Reply::Received);
+    sendToClient(session, WithRequestId(QStringLiteral("\\p%1").arg(pos), requestId), Metrics::Reply::Position);
 }
 
-void AVR::Server::AVRWorkIsComplete()   //When AVR finished it's work send client success message
+void AVR::Server::SendMetrics(Session& session)
 {
-    if(m_bHasClient)
-        sendToClient(m_theOnlyClient, "\\s");   //Success token
+    Metrics::Gauges gauges;
+    gauges.devices = 1;     //Process counters are shared by all devices, but queue is only this one's
+    if(m_pQueue)
+    {
+        gauges.queueDepth = m_pQueue->Depth();
+        gauges.queuePeak = m_pQueue->MaxDepth();
+        gauges.queueCapacity = m_pQueue->Capacity();
+    }
+    sendToClient(session, "\\q" + Metrics::Report(gauges));
 }
 
-void AVR::Server::OnAVRError(AVRSystem::Error code)  //When AVR error occured
+void AVR::Server::CompleteRequest(quint32 requestId)
 {
-    QString errormsg = "\\mAVR Error: ";    //Message token and message text
+    if(!requestId)
+        return;
+    auto it = m_RequestTimes.find(requestId);
+    if(it == m_RequestTimes.end())  //Observer's request or position answered at once
+        return;
+    Metrics::Record(Metrics::Histogram::ReplyLatency, (m_Uptime.nsecsElapsed() - it.value()) / 1000);
+    m_RequestTimes.erase(it);
+}
 
-    switch(code)
+//Wrong trajectory is a protocol error, so it's reported only to its sender, like records for another device
+void AVR::Server::RejectTrajectory(Session& session, quint32 requestId)
+{
+    Metrics::Add(Metrics::Counter::RejectedCommands);
+    if(session.binary)
+        sendRecord(session, Protocol::Opcode::Error, qint32(Protocol::ErrorCode::WrongTrajectory), 0, requestId);
+    else
+        sendToClient(session, WithRequestId(ErrorText(Protocol::ErrorCode::WrongTrajectory), requestId),
+                     Metrics::Reply::Error);
+}
+
+void AVR::Server::NegotiateProtocol(Session& session, const TextProtocol::MessageView& str)
+{
+    int version = str.ToInt(2, str.Length());
+    QString msg;
+    if(version == Protocol::BinaryVersion)
     {
-        case AVRSystem::Error::UnknownMessage:
-            errormsg += "Unknown type of incoming message.";
-            break;
-        case AVRSystem::Error::ValueIsLowerThanZero:
-            errormsg += "Requested position is lower than 0.";
-            break;
-        case AVRSystem::Error::TooHighValue:
-            errormsg += "Requested position is too large and exceeds the maximum value.";
-            break;
-        case AVRSystem::Error::AlreadyMoving:
-            errormsg += "Unexpected behavior. Attempting to move while AVR already moving. Operation canceled.";
-            break;
-        default:
-            errormsg += "Unknown error occured.";
+        msg.sprintf("\\v%i:%i", Protocol::BinaryVersion, int(m_iDeviceId));
+        sendToClient(session, msg);     //Confirming with text message, everything after it is binary
+        session.binary = true;
+    }
+    else    //Text protocol was asked or version is unsupported, staying on text protocol
+    {
+        msg.sprintf("\\v%i:%i", Protocol::TextVersion, int(m_iDeviceId));
+        sendToClient(session, msg);
     }
+}
 
-    if(m_bHasClient)
-        sendToClient(m_theOnlyClient, errormsg);    //Sending error message to client if it exists
+void AVR::Server::HandleRecord(Session& session, const Protocol::Record& record)
+{
+    if(record.device != m_iDeviceId)    //Record is addressed to another device
+    {
+        Metrics::Add(Metrics::Counter::RejectedCommands);
+        sendRecord(session, Protocol::Opcode::Error, qint32(Protocol::ErrorCode::WrongDevice), 0, record.requestId);
+        return;
+    }
+    if(record.opcode == Protocol::Opcode::TrajectoryPoints && session.skippedPoints && record.requestId == session.skippedId)
+    {
+        session.skippedPoints--;    //The rest of rejected or broken trajectory
+        return;
+    }
+    if(session.trajectoryCount)     //Waypoints of binary trajectory are coming
+    {
+        if(record.opcode == Protocol::Opcode::TrajectoryPoints && record.requestId == session.trajectoryId)
+        {
+            session.trajectory.append(record.arg0);
+            if(session.trajectory.size() < session.trajectoryCount)
+                session.trajectory.append(record.arg1);
+            if(session.trajectory.size() == session.trajectoryCount)    //All waypoints came
+            {
+                QVector<int> waypoints;
+                waypoints.swap(session.trajectory);
+                session.trajectoryCount = 0;
+                DispatchMessage(session, AVR::Message(waypoints, record.requestId));
+            }
+            return;
+        }
+        //Another record came before all waypoints, trajectory is broken. The record itself is handled as usual,
+        //waypoints of trajectory which may come after it are dropped.
+        RejectTrajectory(session, session.trajectoryId);
+        session.skippedPoints = (session.trajectoryCount - session.trajectory.size() + 1) / 2;
+        session.skippedId = session.trajectoryId;
+        session.trajectory.clear();
+        session.trajectoryCount = 0;
+    }
+    if(record.opcode == Protocol::Opcode::Trajectory)   //Waypoints come in next records
+    {
+        if(record.arg0 < 1 || record.arg0 > Protocol::MaxWaypoints)
+        {
+            RejectTrajectory(session, record.requestId);    //Error is sent once, its waypoints are dropped
+            session.skippedPoints = record.arg0 > 0 ? int((qint64(record.arg0) + 1) / 2) : 0;
+            session.skippedId = record.requestId;
+            return;
+        }
+        session.trajectoryCount = record.arg0;
+        session.trajectoryId = record.requestId;
+        if(session.skippedId == record.requestId)
+            session.skippedPoints = 0;  //Waypoints with this ID belong to new trajectory now
+        session.trajectory.clear();
+        session.trajectory.reserve(record.arg0);
+        return;
+    }
+    if(record.opcode == Protocol::Opcode::TrajectoryPoints)
+    {
+        //Waypoints which no trajectory header accounts for. Client must know its trajectory is lost.
+        RejectTrajectory(session, record.requestId);
+        return;
+    }
+
+    //Client's opcodes are the same as AVR message types, unknown ones will be reported by AVR System
+    DispatchMessage(session, AVR::Message(AVR::Message::Type(record.opcode), record.arg0, record.requestId));
 }
 
-void AVR::Server::SendPosition(int pos) //Sending AVR position to client
+QString AVR::Server::WithRequestId(const QString& str, quint32 requestId)
 {
-    QString msg;
-    msg.sprintf("\\p%i", pos);  //Position token and received position from AVR System
-    if(m_bHasClient)
-        sendToClient(m_theOnlyClient, msg); //Sending position to client if it exists
+    if(requestId)   //Request ID goes after reply, the same way as in client's command
+        return str + QStringLiteral("#%1").arg(requestId);
+    return str;
+}
+
+void AVR::Server::sendToClient(Session& session, const QString& str, Metrics::Reply kind) //Sends data to client
+{
+    TextProtocol::AppendMessage(session.output, str);   //Block is encoded right in output buffer
+    Metrics::CountReply(kind);
+    OnOutput(session);
+}
+
+void AVR::Server::sendRecord(Session& session, Protocol::Opcode opcode, qint32 arg0, qint32 arg1, quint32 requestId)
+{
+    //Record is encoded right in output buffer
+    int offset = session.output.size();
+    session.output.resize(offset + Protocol::RecordSize);
+    Protocol::Encode({opcode, m_iDeviceId, arg0, arg1, requestId}, reinterpret_cast<uchar*>(session.output.data()) + offset);
+    Metrics::CountReply(opcode);
+    OnOutput(session);
+}
+
+void AVR::Server::OnOutput(Session& session)
+{
+    if(session.output.size() >= flushThreshold)     //Burst of messages, no reason to wait more
+    {
+        WriteOutput(session);
+        return;
+    }
+    if(session.outputPending)
+        return;
+    if(m_PendingOutput.isEmpty())   //First output in this event loop iteration
+        QTimer::singleShot(0, this, &Server::FlushOutput);
+    session.outputPending = true;
+    m_PendingOutput.append(session.socket);
+}
+
+void AVR::Server::FlushOutput()
+{
+    //Controller's output goes to network first
+    if(m_pController && !m_Sessions[m_pController].output.isEmpty())
+    {
+        WriteOutput(m_Sessions[m_pController]);
+    }
+    for(QTcpSocket* socket : m_PendingOutput)
+    {
+        auto it = m_Sessions.find(socket);
+        if(it == m_Sessions.end())  //Disconnected already
+            continue;
+        Session& session = it.value();
+        session.outputPending = false;
+        if(session.output.isEmpty())    //Written already
+            continue;
+        WriteOutput(session);
+    }
+    m_PendingOutput.clear();
+}
+
+void AVR::Server::WriteOutput(Session& session)
+{
+    TraceScope trace("socket write");
+    Metrics::Add(Metrics::Counter::BytesOut, quint64(session.output.size()));
+    session.socket->write(session.output);
+    session.output.clear();
+}
+
+template<typename TextFormer>
+void AVR::Server::Broadcast(Protocol::Opcode opcode, qint32 arg0, qint32 arg1, quint32 requestId, TextFormer formText)
+{
+    TraceScope trace("reply", requestId);
+    //Event is encoded for controller with its request ID, and once per protocol for observers without it:
+    //observers number their own requests from 1 too, so controller's ID would complete observer's request.
+    QByteArray textBlock, binaryBlock;  //Encoded event for observers. It's copied to output buffers of all of them.
+    auto encode = [&](QByteArray& out, bool binary, quint32 id)     //Appends event to the end of out
+    {
+        if(binary)
+        {
+            int offset = out.size();
+            out.resize(offset + Protocol::RecordSize);
+            Protocol::Encode({opcode, m_iDeviceId, arg0, arg1, id}, reinterpret_cast<uchar*>(out.data()) + offset);
+        }
+        else
+            TextProtocol::AppendMessage(out, formText(id));
+        Metrics::CountReply(opcode);
+    };
+
+    if(m_pController)   //Controller is always first, observers can't delay its replies
+    {
+        Session& controller = m_Sessions[m_pController];
+        encode(controller.output, controller.binary, requestId);    //Encoded right in its output buffer
+        OnOutput(controller);
+    }
+
+    QVector<QTcpSocket*> lagging;   //Observers which don't read their data
+    for(auto it = m_Sessions.begin(); it != m_Sessions.end(); ++it)
+    {
+        if(it.key() == m_pController)
+            continue;
+        Session& observer = it.value();
+        if(it.key()->bytesToWrite() + observer.output.size() > maxObserverBacklog)
+        {
+            lagging.append(it.key());
+            continue;
+        }
+        QByteArray& block = observer.binary ? binaryBlock : textBlock;
+        if(block.isEmpty())     //First observer which uses this protocol, encoding event for it
+            encode(block, observer.binary, 0);
+        else
+            Metrics::CountReply(opcode);
+        observer.output.append(block);
+        OnOutput(observer);
+    }
+    if(!lagging.isEmpty())
+        Metrics::Add(Metrics::Counter::DroppedObservers, quint64(lagging.size()));
+    for(QTcpSocket* socket : lagging)   //Disconnecting them after loop, because it removes their sessions
+        socket->abort();
+}
+
+AVR::Message AVR::Server::FormMessage(const TextProtocol::MessageView& str)   //Create AVR::Message from incoming client's message
+{
+    //Message is parsed in place: <ActionCode>:<StepCount>, or just <ActionCode> if there is no ':' delimiter,
+    //both may be followed by #<RequestID>
+    TraceScope trace("decode");
+    TextProtocol::Command command = TextProtocol::ParseCommand(str);
+    trace.SetRequestId(command.requestId);
+    if(command.code == int(AVR::Message::Type::Trajectory))  //List of waypoints instead of step count
+    {
+        int waypoints[Protocol::MaxWaypoints];
+        int count = TextProtocol::ParseList(str, command.argsFrom, command.argsTo, waypoints, Protocol::MaxWaypoints);
+        QVector<int> trajectory(qMax(count, 0));    //Too long trajectory is left empty and rejected
+        std::copy(waypoints, waypoints + trajectory.size(), trajectory.begin());
+        return AVR::Message(trajectory, command.requestId);
+    }
+    return AVR::Message(AVR::Message::Type(command.code), command.steps, command.requestId);  //Returning AVR::Message
+}
+
+void AVR::Server::AVRWorkIsComplete(quint32 requestId)   //When AVR finished it's work send clients success message
+{
+    CompleteRequest(requestId);
+    Broadcast(Protocol::Opcode::Success, 0, 0, requestId, [&](quint32 id)
+    {
+        return WithRequestId("\\s", id);   //Success token
+    });
+}
+
+QString AVR::Server::ErrorText(Protocol::ErrorCode code)
+{
+    return QStringLiteral("\\m") + TextProtocol::ErrorPrefix + Protocol::ErrorText(code);   //Message token and message text
+}
+
+void AVR::Server::OnAVRError(AVRSystem::Error code, quint32 requestId)  //When AVR error occured
+{
+    Metrics::CountError(code);
+    CompleteRequest(requestId);
+    //Binary clients get only error code
+    Broadcast(Protocol::Opcode::Error, qint32(code), 0, requestId, [&](quint32 id)
+    {
+        return WithRequestId(ErrorText(Protocol::ErrorCode(code)), id);   //AVR errors have the same codes
+    });
+}
+
+void AVR::Server::SendPosition(int pos, quint32 requestId) //Sending AVR position to clients
+{
+    CompleteRequest(requestId);
+    Broadcast(Protocol::Opcode::Position, pos, 0, requestId, [&](quint32 id)
+    {
+        QString msg;
+        msg.sprintf("\\p%i", pos);  //Position token and received position from AVR System
+        return WithRequestId(msg, id);
+    });
 }
 
 void AVR::Server::OnClientDisconnected()    //This slot runs when client has been disconnected
 {
-    m_bHasClient = false;   //We have no client
-    m_theOnlyClient = nullptr;
     QTcpSocket* clientSocket = qobject_cast<QTcpSocket *>(QObject::sender()); //Getting disconnected client's socket
+    if(!m_Sessions.remove(clientSocket))
+        return;
     clientSocket->deleteLater();    //Asking him for deleting
-    emit ChangeConnectionLabel(false);  //Sending signal to UI: Change connection lable state to Disconnected
+    if(clientSocket == m_pController)
+    {
+        m_pController = nullptr;    //Next connected client will control AVR
+        m_RequestTimes.clear();     //Replies to its requests won't be measured
+        emit ClientDisconnected();  //Saying AVR System that nobody needs position updates anymore
+        emit ChangeConnectionLabel(false);  //Sending signal to UI: Change connection lable state to Disconnected
+    }
+    else
+        emit ObserverConnected(false);
 }
 
-//When AVR System received a message from client
-void AVR::Server::OnMessageReceived(Message::Type type, int ReceivedSteps)
+QString AVR::Server::ReceivedText(Message::Type type, int ReceivedSteps)
 {
     QString msg = "\\r";    //Message received token
     switch(type)
@@ -226,19 +703,94 @@ void AVR::Server::OnMessageReceived(Message::Type type, int ReceivedSteps)
             msg += "3";
             break;
 
+        case Message::Type::Subscribe:  //Interval of position updates is sent back as step count
+            msg = "";
+            msg.sprintf("\\r4:%i", ReceivedSteps);
+            break;
+
+        case Message::Type::Unsubscribe:
+            msg += "5";
+            break;
+
+        case Message::Type::Stop:
+            msg += "6";
+            break;
+
+        case Message::Type::Retarget:   //New goal position is sent back as step count
+            msg = "";
+            msg.sprintf("\\r7:%i", ReceivedSteps);
+            break;
+
+        case Message::Type::MoveTo:     //Goal position is sent back as step count
+            msg = "";
+            msg.sprintf("\\r8:%i", ReceivedSteps);
+            break;
+
+        case Message::Type::Trajectory: //Waypoint count is sent back as step count
+            msg = "";
+            msg.sprintf("\\r9:%i", ReceivedSteps);
+            break;
+
         default:
             msg += "0";
     }
+    return msg;
+}
+
+//When AVR System received a message from client
+void AVR::Server::OnMessageReceived(Message::Type type, int ReceivedSteps, quint32 requestId)
+{
+    if(type == Message::Type::Subscribe || type == Message::Type::Unsubscribe)
+        CompleteRequest(requestId);     //\r is the last reply to them
+    Broadcast(Protocol::Opcode::Received, qint32(type), ReceivedSteps, requestId, [&](quint32 id)
+    {
+        return WithRequestId(ReceivedText(type, ReceivedSteps), id);
+    });
+}
 
-    if(m_bHasClient)
-        sendToClient(m_theOnlyClient, msg); //Sending response to client if it exists
+void AVR::Server::OnWaypointReached(int index, int pos, quint32 requestId)  //Sending reached waypoint of trajectory
+{
+    Broadcast(Protocol::Opcode::WaypointReached, index, pos, requestId, [&](quint32 id)
+    {
+        QString msg;
+        msg.sprintf("\\w%i:%i", index, pos);
+        return WithRequestId(msg, id);
+    });
+}
+
+void AVR::Server::OnMoveHalted(int pos, quint32 requestId)    //Sending position where move was interrupted
+{
+    CompleteRequest(requestId);
+    Broadcast(Protocol::Opcode::Halted, pos, 0, requestId, [&](quint32 id)
+    {
+        return WithRequestId(QStringLiteral("\\h%1").arg(pos), id);
+    });
 }
 
-//When AVR Systems sends init data to server for new client
+void AVR::Server::OnTelemetry(int pos)  //Sending position update to clients
+{
+    Broadcast(Protocol::Opcode::Telemetry, pos, 0, 0, [&](quint32)
+    {
+        QString msg;
+        msg.sprintf("\\t%i", pos);  //Position update token and position from AVR System
+        return msg;
+    });
+}
+
+//When AVR Systems sends init data to server for new clients
 void AVR::Server::OnClientInit(int currentPos, int maxPos)
 {
     QString msg;
     msg.sprintf("\\i%i:%i", currentPos, maxPos);    //Form init data message with init token
-    if(m_bHasClient)
-        sendToClient(m_theOnlyClient, msg); //Sending init data to new client if it still exists
+    for(auto it = m_Sessions.begin(); it != m_Sessions.end(); ++it)
+    {
+        Session& session = it.value();
+        if(!session.waitsForInit)   //Clients connected earlier are initialized already
+            continue;
+        session.waitsForInit = false;
+        if(session.binary)  //Client could switch protocol before AVR System answered
+            sendRecord(session, Protocol::Opcode::Init, currentPos, maxPos);
+        else
+            sendToClient(session, msg, Metrics::Reply::Init);  //Sending init data to new client
+    }
 }
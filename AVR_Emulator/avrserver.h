@@ -3,48 +3,122 @@
 #include <QObject>
 #include <QTcpSocket>
 #include <QTcpServer>
+#include <QHash>
+#include <QVector>
+#include <QElapsedTimer>
 #include "avrmessage.h"
 #include "avrsystem.h"
+#include "avrprotocol.h"
+#include "avrtextprotocol.h"
+#include "avrmetrics.h"
+#include "avrtrace.h"
 
 namespace AVR
 {
     //This is AVR Server class. It implements connection between controlling interface and AVR System.
-    //AVR Server could have only one client, other client's connections would be rejected.
+    //AVR Server has one controlling client and any number of read-only observers. First connected client controls AVR,
+    //next ones become observers until controller disconnects. Observers get all replies sent to controller and position
+    //updates, but can only ask position by themselves.
     //Server uses TCP connection and could be hosted even through the internet.
     class Server : public QObject
     {
         Q_OBJECT
 
     private:
+        struct Session      //Connection of one client
+        {
+            QTcpSocket* socket;     //Socket linked to connected client
+            quint16 nextBlockSize;  //Data block size (needed for internal server work)
+            bool binary;            //Does client use binary protocol (negotiated by \v token) or text one
+            bool observer;          //Read-only client. It watches AVR but can't send orders.
+            bool waitsForInit;      //Client didn't get \i message yet
+            QByteArray output;      //Messages encoded for client but not written to socket yet
+            bool outputPending;     //Session is in list of sessions waiting for output flush
+            QVector<int> trajectory;    //Waypoints of binary trajectory received so far
+            int trajectoryCount;        //Waypoint count of binary trajectory being received. 0 if there is no such one.
+            quint32 trajectoryId;       //Request ID of binary trajectory being received
+            int skippedPoints;          //TrajectoryPoints records of rejected or broken trajectory which are still to come.
+                                        //They are dropped silently, its sender got error already.
+            quint32 skippedId;          //Request ID of rejected or broken trajectory
+        };
+
         QTcpServer m_ptcpServer;   //The server instance.
-        quint16 m_nNextBlockSize;   //Data block size (needed for internal server work)
-        QTcpSocket* m_theOnlyClient;    //Current only client. This is socket linked to connected client if it exists.
-        bool m_bHasClient;  //State of server. Does it have client or not.
+        QHash<QTcpSocket*, Session> m_Sessions;     //All connected clients
+        QTcpSocket* m_pController;  //Socket of controlling client. nullptr if there is no controller now.
+        QVector<QTcpSocket*> m_PendingOutput;   //Sessions which have something in output buffer
+        const AVRSystem* m_pAVR;    //AVR System served by this server. Used for answering position requests directly.
+        CommandQueue* m_pQueue;     //Command queue of AVR System. nullptr if commands go by AVRMessage signal.
+        CommandQueue::OverloadPolicy m_OverloadPolicy;  //What to do with controller's commands when queue is full
+        quint16 m_iDeviceId;        //ID of served device in binary protocol records
+        QElapsedTimer m_Uptime;     //Time source of reply latency metrics
+        QHash<quint32, qint64> m_RequestTimes;  //When controller's commands which went to AVR System were read, by request ID
 
     private:
-        void sendToClient(QTcpSocket* pSocket, const QString& str); //Sends data to connected client
-        AVR::Message FormMessage(const QString& str);  //Forms AVR::Message instance from incoming message of client.
+        static QString WithRequestId(const QString& str, quint32 requestId);   //Adds #<RequestID> to reply if ID is set
+        static QString ErrorText(Protocol::ErrorCode code); //Returns \m message with description of error
+        static QString ReceivedText(Message::Type type, int ReceivedSteps);    //Returns \r message for received message
+        //Messages are encoded right in session's output buffer. Buffer is written to socket once per event loop iteration,
+        //so all replies and updates produced by one batch of events go to socket by one write.
+        //kind tells metrics what was sent, broadcast events are counted by their opcode.
+        void sendToClient(Session& session, const QString& str,
+                          Metrics::Reply kind = Metrics::Reply::Other); //Sends data to connected client
+        void sendRecord(Session& session, Protocol::Opcode opcode, qint32 arg0 = 0, qint32 arg1 = 0,
+                        quint32 requestId = 0); //Sends binary record to client
+        void OnOutput(Session& session);    //Schedules writing of session's output, or writes it at once if it's big
+        void FlushOutput();                 //Writes output buffers of all sessions to their sockets
+        void WriteOutput(Session& session); //Writes session's output buffer to its socket at once
+        //Sends the same event to controller and all observers. Controller gets it with requestId, observers without it,
+        //so their own requests can't be completed by controller's replies. Observers' message of every protocol is
+        //encoded only once. formText(id) forms text with request ID id, it's called only if text is needed.
+        template<typename TextFormer>
+        void Broadcast(Protocol::Opcode opcode, qint32 arg0, qint32 arg1, quint32 requestId, TextFormer formText);
+        AVR::Message FormMessage(const TextProtocol::MessageView& str);  //Forms AVR::Message instance from incoming message of client.
+        void NegotiateProtocol(Session& session, const TextProtocol::MessageView& str);   //Handles client's \v request for protocol version
+        void ReadSession(Session& session);     //Reads and handles all complete messages which client has sent
+        void HandleRecord(Session& session, const Protocol::Record& record);  //Handles binary record from client
+        void RejectTrajectory(Session& session, quint32 requestId);   //Says client that its trajectory is wrong
+        void DispatchMessage(Session& session, const AVR::Message& msg);  //Answers position request or passes message to AVR System
+        void AnswerObserver(Session& session, const AVR::Message& msg);   //Answers read-only client by itself
+        void SendMetrics(Session& session);     //Answers client's \q query by metrics report
+        void CompleteRequest(quint32 requestId);    //Records latency of request which got its last reply
 
     public:
-        //Server's ctor, accepts host and port for listening.
+        //Server's ctor, accepts host and port for listening. Throws std::runtime_error if port can't be listened.
+        //Listening server could be moved to its network thread after construction.
         Server(const QHostAddress& host, int nPort, QObject* pwgt =0);
         ~Server();
 
+        //Lets server answer position requests by AVR System's thread-safe GetCurrentPos() in server's thread,
+        //without waiting in AVR thread's queue. Without attached AVR System they go to AVR thread as other messages.
+        void AttachAVR(const AVRSystem* avr);
+        void SetDeviceId(quint16 id);   //Sets device ID for binary protocol records. It's 0 by default.
+        //Makes server push controller's commands right to AVR System's bounded queue instead of AVRMessage signal.
+        //When queue is full server stops reading controller's socket (Block) or answers with error (Reject).
+        void AttachQueue(CommandQueue* queue, CommandQueue::OverloadPolicy policy);
+
     public slots:
         void slotNewConnection();   //Slot of new incoming connection. Triggers when someone connects.
         void OnClientDisconnected();        //Triggers when client has been disconnected.
         void slotReadClient();              //Retrieving data from client
+        void OnQueueHasSpace();             //Triggers when AVR System took commands from full queue. Resumes reading.
 
-        void AVRWorkIsComplete();           //Triggers when AVR finished moving
-        void OnAVRError(AVRSystem::Error code);          //Triggers when AVR error occurred
-        void SendPosition(int pos);         //Sends current AVR position to client
-        void OnMessageReceived(Message::Type type, int ReceivedSteps);  //Triggers when AVR system recieved message.
+        //Replies to client's requests. requestId is ID of request this is reply to, 0 if client didn't set it.
+        void AVRWorkIsComplete(quint32 requestId);  //Triggers when AVR finished moving
+        void OnAVRError(AVRSystem::Error code, quint32 requestId);   //Triggers when AVR error occurred
+        void SendPosition(int pos, quint32 requestId);   //Sends current AVR position to client
+        void OnMessageReceived(Message::Type type, int ReceivedSteps, quint32 requestId);  //Triggers when AVR system recieved message.
+        void OnWaypointReached(int index, int pos, quint32 requestId);   //Triggers when AVR reached waypoint of trajectory
+        void OnMoveHalted(int pos, quint32 requestId);  //Triggers when move was interrupted by Stop or Retarget
+        void OnTelemetry(int pos);          //Sends position update to subscribed client
         void OnClientInit(int currentPos, int maxPos);  //Triggers when AVR system says to
                                                         //client it's current position and max position.
                                                         //Position on client init is ALWAYS true.
     signals:
         void AVRMessage(AVR::Message msg);  //Sends formed AVR::Message from client to AVR system
+        void CommandsQueued();      //Says to AVR system that there are new commands in its queue
         void ChangeConnectionLabel(bool IsConnected);   //Says to UI form to change connection label's state text.
+        void ObserverConnected(bool IsConnected);       //Says to UI form that observer has connected (or disconnected).
+        void ClientDisconnected();     //Says to AVR system that controlling client has gone and it should stop position updates
         void AskForClientInit();       //Says to AVR system to emit signal for server with it's current
                                        //position and maximum position. This position is ALWAYS true.
                                        //Server will send this data to client for it's initialization.
@@ -0,0 +1,268 @@
+#include "avrsettings.h"
+
+namespace AVR
+{
+    bool Settings::ParseArguments(const QStringList& args, QString& error)
+    {
+        QString item;   //For iterated strings of arguments
+
+        //Means that argument of next iteration will be host or port value
+        bool nextIsHost = false, nextIsPort = false, nextIsMaxPos = false, nextIsChanceToLie = false, nextIsClock = false, nextIsDevices = false, nextIsFps = false, nextIsIOThreads = false, nextIsQueue = false, nextIsOverload = false, nextIsProfile = false, nextIsSeed = false, nextIsMetrics = false, nextIsTrace = false;
+        for (int i = 0; i < args.size(); i++)    //Arguments iteration
+        {
+            item = args.at(i);  //Get argument value
+
+            if (item == "-host")   //If argument is -host
+            {
+                nextIsHost = true;  //Than next argument will be host value
+                continue;
+            }
+
+            if (item == "-port")   //If argument is -port
+            {
+                nextIsPort = true;  //Than next argument will be port value
+                continue;
+            }
+
+            if (item == "-ctl")   //If argument is -ctl
+            {
+                nextIsChanceToLie= true;  //Than next argument will be chance to lie value
+                continue;
+            }
+
+            if (item == "-maxpos")   //If argument is -port
+            {
+                nextIsMaxPos = true;  //Than next argument will be maximum position value
+                continue;
+            }
+
+            if (item == "-clock")   //If argument is -clock
+            {
+                nextIsClock = true;  //Than next argument will be clock mode
+                continue;
+            }
+
+            if (item == "-devices")   //If argument is -devices
+            {
+                nextIsDevices = true;  //Than next argument will be device count
+                continue;
+            }
+
+            if (item == "-fps")   //If argument is -fps
+            {
+                nextIsFps = true;  //Than next argument will be display rate
+                continue;
+            }
+
+            if (item == "-iothreads")   //If argument is -iothreads
+            {
+                nextIsIOThreads = true;  //Than next argument will be network thread count
+                continue;
+            }
+
+            if (item == "-queue")   //If argument is -queue
+            {
+                nextIsQueue = true;  //Than next argument will be command queue depth
+                continue;
+            }
+
+            if (item == "-overload")   //If argument is -overload
+            {
+                nextIsOverload = true;  //Than next argument will be overload policy
+                continue;
+            }
+
+            if (item == "-profile")   //If argument is -profile
+            {
+                nextIsProfile = true;  //Than next argument will be list of acceleration profiles
+                continue;
+            }
+
+            if (item == "-seed")   //If argument is -seed
+            {
+                nextIsSeed = true;  //Than next argument will be random seed
+                continue;
+            }
+
+            if (item == "-metrics")   //If argument is -metrics
+            {
+                nextIsMetrics = true;  //Than next argument will be metrics endpoint port
+                continue;
+            }
+
+            if (item == "-trace")   //If argument is -trace
+            {
+                nextIsTrace = true;  //Than next argument will be trace file
+                continue;
+            }
+
+            if (nextIsHost)
+            {
+                host = QHostAddress(item);    //Saving custom host value
+                nextIsHost = false;
+            }
+
+            if (nextIsPort)
+            {
+                port = item.toInt();    //Saving custom port value
+                nextIsPort = false;
+            }
+
+            if (nextIsChanceToLie)
+            {
+                chanceToLie = item.toInt();    //Saving custom port value
+                if (chanceToLie < 0 || chanceToLie > 100)
+                {
+                    error = "Incorrect chance to lie has been passed. Correct value must be between 0 and 100.";
+                    return false;   //Incorrect chance to lie
+                }
+                nextIsChanceToLie = false;
+            }
+
+            if (nextIsMaxPos)
+            {
+                maxPos = item.toInt();    //Saving custom port value
+                if (maxPos < 1 || maxPos > 100000)
+                {
+                    error = "Incorrect maximum position has been passed. This value must be between 1 and 100000.";
+                    return false;   //Incorrect maximum position
+                }
+
+                nextIsMaxPos = false;
+            }
+
+            if (nextIsClock)
+            {
+                if (item == "real")     //Real time
+                    clock = Clock(Clock::Mode::RealTime);
+                else if (item == "virtual")     //Moves are complete instantly
+                    clock = Clock(Clock::Mode::Virtual);
+                else    //Otherwise it's time scale factor, e.g. 100 means 100 times faster than real time
+                {
+                    bool isNumber = false;
+                    double scale = item.toDouble(&isNumber);
+                    if (!isNumber || scale <= 0)
+                    {
+                        error = "Incorrect clock mode has been passed. It must be 'real', 'virtual' or positive time scale factor.";
+                        return false;   //Incorrect clock mode
+                    }
+                    clock = Clock(Clock::Mode::Scaled, scale);
+                }
+                nextIsClock = false;
+            }
+
+            if (nextIsDevices)
+            {
+                deviceCount = item.toInt();    //Saving device count
+                if (deviceCount < 1 || deviceCount > 10000)
+                {
+                    error = "Incorrect device count has been passed. This value must be between 1 and 10000.";
+                    return false;   //Incorrect device count
+                }
+                nextIsDevices = false;
+            }
+
+            if (nextIsFps)
+            {
+                displayRate = item.toInt();    //Saving display rate
+                if (displayRate < 0 || displayRate > 1000)
+                {
+                    error = "Incorrect display rate has been passed. This value must be between 0 and 1000.";
+                    return false;   //Incorrect display rate
+                }
+                nextIsFps = false;
+            }
+
+            if (nextIsIOThreads)
+            {
+                ioThreadCount = item.toInt();    //Saving network thread count
+                if (ioThreadCount < 0 || ioThreadCount > 64)
+                {
+                    error = "Incorrect network thread count has been passed. This value must be between 0 and 64.";
+                    return false;   //Incorrect network thread count
+                }
+                nextIsIOThreads = false;
+            }
+
+            if (nextIsQueue)
+            {
+                queueDepth = item.toInt();    //Saving command queue depth
+                if (queueDepth < 1 || queueDepth > 100000)
+                {
+                    error = "Incorrect command queue depth has been passed. This value must be between 1 and 100000.";
+                    return false;   //Incorrect queue depth
+                }
+                nextIsQueue = false;
+            }
+
+            if (nextIsOverload)
+            {
+                if (item == "block")
+                    overload = CommandQueue::OverloadPolicy::Block;
+                else if (item == "reject")
+                    overload = CommandQueue::OverloadPolicy::Reject;
+                else
+                {
+                    error = "Incorrect overload policy has been passed. It must be block or reject.";
+                    return false;   //Unknown policy
+                }
+                nextIsOverload = false;
+            }
+
+            if (nextIsProfile)
+            {
+                profiles.clear();
+                for (const QString& name : item.split(','))   //Devices get profiles from list in turn
+                {
+                    if (name == "geometric")
+                        profiles.append(MotionProfile::GeometricRamp);
+                    else if (name == "trapezoidal")
+                        profiles.append(MotionProfile::Trapezoidal);
+                    else if (name == "scurve")
+                        profiles.append(MotionProfile::SCurve);
+                    else
+                    {
+                        error = "Incorrect acceleration profile has been passed. It must be geometric, trapezoidal or scurve.";
+                        return false;   //Unknown profile
+                    }
+                }
+                nextIsProfile = false;
+            }
+
+            if (nextIsSeed)
+            {
+                seed = item.toULongLong(&hasSeed);    //Saving random seed
+                if (!hasSeed)
+                {
+                    error = "Incorrect random seed has been passed. This value must be non-negative integer.";
+                    return false;   //Incorrect seed
+                }
+                nextIsSeed = false;
+            }
+
+            if (nextIsMetrics)
+            {
+                metricsPort = item.toInt();    //Saving metrics endpoint port
+                if (metricsPort < 1 || metricsPort > 65535)
+                {
+                    error = "Incorrect metrics port has been passed. This value must be between 1 and 65535.";
+                    return false;   //Incorrect metrics port
+                }
+                nextIsMetrics = false;
+            }
+
+            if (nextIsTrace)
+            {
+                traceFile = item;    //Saving trace file path
+                nextIsTrace = false;
+            }
+        }
+
+        if (port < 1 || port + deviceCount - 1 > 65535)    //Every device needs its own port
+        {
+            error = "Incorrect port has been passed. Ports of all devices must be between 1 and 65535.";
+            return false;   //Incorrect port
+        }
+        return true;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QStringList>
+#include <QHostAddress>
+#include <QVector>
+#include "avrclock.h"
+#include "avrcommandqueue.h"
+#include "avrmotion.h"
+
+namespace AVR
+{
+    //Launch settings of AVR emulator. Default values are used if launch argument wasn't passed.
+    struct Settings
+    {
+        QHostAddress host = QHostAddress::Any;  //Host to listen
+        int port = 28338;                       //Port of the first device
+        int chanceToLie = 10;                   //Chance to lie about position, between 0 and 100
+        int maxPos = 15000;                     //Maximum position of AVR
+        Clock clock;                            //Simulation clock, real time by default
+        int deviceCount = 1;                    //How much AVR devices to host
+        int displayRate = 25;                   //Position display updates per second while moving (0 - only final position)
+        int ioThreadCount = 0;                  //Network threads of servers (0 - chosen by device count)
+        int queueDepth = 64;                    //How much client's commands can wait for execution
+        CommandQueue::OverloadPolicy overload = CommandQueue::OverloadPolicy::Block;   //What to do when command queue is full
+        bool hasSeed = false;                   //Was random seed passed. Without it every run lies differently.
+        quint64 seed = 0;                       //Random seed of lies. Every device gets its own seed derived from it.
+        QVector<MotionProfile> profiles = {MotionProfile::GeometricRamp};   //Acceleration profiles of devices.
+                                                                            //Device i gets profiles[i % profiles.size()].
+        int metricsPort = 0;                    //Localhost port of metrics endpoint (0 - no endpoint)
+        QString traceFile;                      //Chrome trace is written to this file when host stops (empty - no tracing)
+
+        //Reads settings from launch arguments. Returns false and error description if any argument is incorrect.
+        bool ParseArguments(const QStringList& args, QString& error);
+    };
+}
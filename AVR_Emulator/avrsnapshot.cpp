@@ -0,0 +1,57 @@
+#include "avrsnapshot.h"
+
+namespace AVR
+{
+    PositionSnapshot::PositionSnapshot()
+        : m_Sequence(0),
+          m_bMoving(false),
+          m_iStartPosition(0),
+          m_iGoalPosition(0),
+          m_StartTime(0),
+          m_iProfile(int(MotionProfile::GeometricRamp))
+    {
+    }
+
+    void PositionSnapshot::Publish(bool moving, const Motion& motion)
+    {
+        unsigned sequence = m_Sequence.load(std::memory_order_relaxed);
+        m_Sequence.store(sequence + 1, std::memory_order_relaxed);  //Readers will retry until we are done
+        std::atomic_thread_fence(std::memory_order_release);
+
+        m_bMoving.store(moving, std::memory_order_relaxed);
+        m_iStartPosition.store(motion.GetStartPosition(), std::memory_order_relaxed);
+        m_iGoalPosition.store(motion.GetGoalPosition(), std::memory_order_relaxed);
+        m_StartTime.store(motion.GetStartTime(), std::memory_order_relaxed);
+        m_iProfile.store(int(motion.GetProfile()), std::memory_order_relaxed);
+
+        m_Sequence.store(sequence + 2, std::memory_order_release);  //Snapshot is consistent again
+    }
+
+    void PositionSnapshot::PublishIdle(int position)
+    {
+        Publish(false, Motion(position, position, 0));
+    }
+
+    bool PositionSnapshot::Read(Motion& motion) const
+    {
+        while(true)
+        {
+            unsigned sequence = m_Sequence.load(std::memory_order_acquire);
+            if(sequence & 1)    //Writer is in progress
+                continue;
+
+            bool moving = m_bMoving.load(std::memory_order_relaxed);
+            int startPos = m_iStartPosition.load(std::memory_order_relaxed);
+            int goalPos = m_iGoalPosition.load(std::memory_order_relaxed);
+            qint64 startTime = m_StartTime.load(std::memory_order_relaxed);
+            MotionProfile profile = MotionProfile(m_iProfile.load(std::memory_order_relaxed));
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(m_Sequence.load(std::memory_order_relaxed) != sequence)  //Snapshot was changed while reading, retrying
+                continue;
+
+            motion = Motion(startPos, goalPos, startTime, profile);
+            return moving;
+        }
+    }
+}
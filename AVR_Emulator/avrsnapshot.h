@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include "avrmotion.h"
+
+namespace AVR
+{
+    //Snapshot of AVR System motion state which can be read from any thread without locks.
+    //AVR thread publishes it when move starts or ends, other threads read it at any moment.
+    //It's a sequence lock: reader retries if snapshot was changed while it was reading.
+    class PositionSnapshot
+    {
+    private:
+        std::atomic<unsigned> m_Sequence;   //Odd while writing, incremented twice per publication
+        std::atomic<bool> m_bMoving;        //Is AVR moving
+        std::atomic<int> m_iStartPosition;  //Start position of current move (or current position if idle)
+        std::atomic<int> m_iGoalPosition;   //Goal position of current move (or current position if idle)
+        std::atomic<qint64> m_StartTime;    //Start time of current move
+        std::atomic<int> m_iProfile;        //Acceleration profile of current move
+
+        //Disallow copying
+        PositionSnapshot(const PositionSnapshot&) = delete;
+        PositionSnapshot& operator=(const PositionSnapshot&) = delete;
+
+    public:
+        PositionSnapshot();
+
+        void Publish(bool moving, const Motion& motion);    //Writes new state. Must be called from AVR thread only.
+        void PublishIdle(int position);                     //Writes idle state at certain position.
+        bool Read(Motion& motion) const;    //Reads consistent state. Returns true if AVR is moving.
+                                            //When idle motion starts and ends at current position.
+    };
+}
@@ -1,119 +1,421 @@
-#include "mainwindow.h"
 #include "avrsystem.h"
-#include <QMessageBox>
+#include "avrmetrics.h"
+#include "avrtrace.h"
+#include <QMetaMethod>
 
 namespace AVR
 {
-    //Ctor of AVR System, takes chance to lie (when asking position) and maximum position value
-    AVRSystem::AVRSystem(int ChanceToLie, int MaxPos, QObject *parent)
-        : QObject(parent)
+    namespace
+    {
+        const int defaultDisplayRate = 25;  //Visible position updates per second while moving
+    }
+
+    //Ctor of AVR System, takes chance to lie (when asking position), maximum position value and simulation clock
+    AVRSystem::AVRSystem(int ChanceToLie, int MaxPos, const Clock& clock, QObject *parent)
+        : QObject(parent),
+          m_Clock(clock),
+          m_MoveTimer(this), //Timers are children of AVR System so they will be moved to AVR thread together with it
+          m_DisplayTimer(this),
+          m_TelemetryTimer(this)
     {
         m_State = AVRSystem::State::Idle;
         m_iCurrentPosition = 0;
         m_iGoalPosition = 0;
         m_iChanceToLie = ChanceToLie;
         m_iMaxPos = MaxPos;
+        m_Profile = MotionProfile::GeometricRamp;
+        m_Clock.Start();
+
+        m_MoveTimer.setSingleShot(true);
+        m_MoveTimer.setTimerType(Qt::PreciseTimer);  //Coarse timers could be 5% late, it's too much for long moves
+        m_iDisplayedPosition = 0;
+        m_iTelemetryInterval = -1;
+        m_iTelemetryPosition = 0;
+        m_TelemetryTimer.setTimerType(Qt::PreciseTimer);
+        m_iRequestId = 0;
+        m_iMoveRequestId = 0;
+        m_iWaypoint = 0;
+        m_Snapshot.PublishIdle(m_iCurrentPosition);
+        SetDisplayRate(defaultDisplayRate);
+        QObject::connect(&m_MoveTimer, &QTimer::timeout, this, &AVRSystem::OnMoveTimer);
+        QObject::connect(&m_DisplayTimer, &QTimer::timeout, this, &AVRSystem::OnDisplayTimer);
+        QObject::connect(&m_TelemetryTimer, &QTimer::timeout, this, &AVRSystem::OnTelemetryTimer);
     }
 
     AVRSystem::~AVRSystem() //No data to destroy
     {
     }
 
+    void AVRSystem::SetDisplayRate(int framesPerSecond)
+    {
+        if(framesPerSecond > 0)
+            m_DisplayTimer.setInterval(1000 / framesPerSecond);
+        else
+            m_DisplayTimer.setInterval(0);  //Zero interval means intermediate updates are disabled
+    }
+
+    void AVRSystem::SetMotionProfile(MotionProfile profile)
+    {
+        m_Profile = profile;
+    }
+
+    void AVRSystem::SetRandomSeed(quint64 seed)
+    {
+        m_Random.Seed(seed);
+    }
+
+    void AVRSystem::SetQueueCapacity(int capacity)
+    {
+        m_Queue.SetCapacity(capacity);
+    }
+
+    CommandQueue* AVRSystem::GetCommandQueue()
+    {
+        return &m_Queue;
+    }
+
     void AVRSystem::MoveToZero()    //Moves position to zero, uses MoveToPos()
     {
         MoveToPos(0);
     }
 
-    //This method moves AVR position directly to pos value
-    //Moving is not instant and could take a while.
+    //This method begins moving AVR position directly to pos value
+    //Moving is not instant and could take a while. Position during the move is calculated by m_Motion,
+    //so AVR thread's event loop keeps processing messages and wakes up only for display updates and move completion.
     void AVRSystem::MoveToPos(int pos)
     {
         if(pos < 0) //Non-critical error if future position is lower than 0
         {
-            emit ErrorOccurred(AVRSystem::Error::ValueIsLowerThanZero);
+            emit ErrorOccurred(AVRSystem::Error::ValueIsLowerThanZero, m_iRequestId);
             return;
         }
         else if(pos > m_iMaxPos)    //Non-critical error if future position exceeds maximum position
         {
-            emit ErrorOccurred(AVRSystem::Error::TooHighValue);
+            emit ErrorOccurred(AVRSystem::Error::TooHighValue, m_iRequestId);
             return;
         }
 
+        if(m_State == AVR::AVRSystem::State::Moving)
+        {                                                                       // Stop moving operation and throw an exeption if
+            emit ErrorOccurred(AVRSystem::Error::AlreadyMoving, m_iRequestId);  // system is alredy working.
+            return;                                                             // This situation is impossible in regular application
+        }                                                                       // life, but for some unusual cases this exeption will
+                                                                                // exist for avoiding unforeseen consequences.
+
         //If future position equals current position
         if(pos == m_iCurrentPosition)
         {
-            m_State = AVR::AVRSystem::State::Idle;  //Current state idle now
-            emit WorkIsComplete();  //Saying server that work is complete
+            emit WorkIsComplete(m_iRequestId);  //Saying server that work is complete
             return; //We are done
         }
 
-        if(m_State == AVR::AVRSystem::State::Moving)
-        {                                                           // Stop moving operation and throw an exeption if
-            emit ErrorOccurred(AVRSystem::Error::AlreadyMoving);    // system is alredy working.
-            return;                                                 // This situation is impossible in regular application
-        }                                                           // life, but for some unusual cases this exeption will
-                                                                    // exist for avoiding unforeseen consequences.
-
         m_State = AVR::AVRSystem::State::Moving;  //Now we are moving
         m_iGoalPosition = pos;   //Set goal position to pos
+        m_iMoveRequestId = m_iRequestId;    //Success will be reported to this request
+        Trace::AsyncBegin("move", this, m_iMoveRequestId);
+        m_Motion = Motion(m_iCurrentPosition, m_iGoalPosition, Now(), m_Profile);
+        StartMotion();
+    }
+
+    void AVRSystem::StartMotion()
+    {
+        m_Snapshot.Publish(true, m_Motion);     //Other threads will see we are moving
 
-        int waitTime = 1000;            // Initial pause in milliseconds between moving iterations.
-        const int minumumWaitTime = 5;  // Wait time will be decreased on every iteration until
-                                            // it will reach minumumWaitTime value.
-        const float timeDecreaseFactor = 0.90f;   //This is factor of waitTime decrease per iteration.
+        //Nothing to do until the move is complete, except updating UI sometimes
+        m_MoveTimer.start(m_Clock.TimerInterval(m_Motion.FinishTime()));
+        //Intermediate positions are shown only if someone is watching them. Headless host has no UI at all,
+        //and virtual move is over at once, nothing to show in between.
+        if(m_DisplayTimer.interval() > 0 && m_Clock.GetMode() != Clock::Mode::Virtual &&
+           isSignalConnected(QMetaMethod::fromSignal(&AVRSystem::UpdateDisplay)))
+            m_DisplayTimer.start();
+        StartTelemetry();
+        ShowPosition(m_Motion.PositionAt(Now()));  //Sending signal to UI for updating visible position value
+    }
 
-        //This is move direction. Value equals 1 if system moving forward.
-        //step value is actualy how much steps will be passed per iteration.
-        int step = 1;
-        if(m_iGoalPosition < m_iCurrentPosition)
-            step = -1;  //Or if goal position is lower than current value will be -1. System moving backward.
+    //Retarget changes goal without waiting for the end of current move.
+    //If AVR keeps its direction (and profile allows it), the move goes on with the same speed, only its end is moved.
+    //If new goal is behind AVR, it stops where it is and starts new move from this position (with slow first steps).
+    void AVRSystem::Retarget(int pos)
+    {
+        if(pos < 0 || pos > m_iMaxPos || m_State != AVRSystem::State::Moving)
+        {
+            emit MessageReceived(Message::Type::Retarget, pos, m_iRequestId);
+            MoveToPos(pos);     //Reports wrong position, or starts new move if AVR is idle
+            return;
+        }
 
-        //We are begining from current position and moving until position isn't equal goal position
-        for(int i = m_iCurrentPosition; i != (m_iGoalPosition + step); i += step)
+        int truePos = GetTruePos();
+        m_Trajectory.clear();   //New goal replaces the rest of trajectory too
+        Trace::AsyncEnd("move", this, m_iMoveRequestId);
+        emit MoveHalted(truePos, m_iMoveRequestId);     //Previous order won't reach its goal, this one replaces it
+        emit MessageReceived(Message::Type::Retarget, pos, m_iRequestId);
+        m_iMoveRequestId = m_iRequestId;
+        Trace::AsyncBegin("move", this, m_iMoveRequestId);
+        int direction = m_Motion.GetGoalPosition() < m_Motion.GetStartPosition() ? -1 : 1;
+        Motion extended(m_Motion.GetStartPosition(), pos, m_Motion.GetStartTime(), m_Profile);  //Same move, another end
+        //Profiles with deceleration change their whole shape with distance, so move can be extended
+        //only if AVR would be at the same place in it. Otherwise it's restarted from here.
+        if((pos - truePos) * direction >= 0 && pos != m_Motion.GetStartPosition() && extended.PositionAt(Now()) == truePos)
+            m_Motion = extended;
+        else if(pos != truePos)
+        {
+            Metrics::Record(Metrics::Histogram::MoveDuration, Now() - m_Motion.GetStartTime());   //Old move ends here
+            m_iCurrentPosition = truePos;   //New move starts right here
+            m_Motion = Motion(truePos, pos, Now(), m_Profile);
+        }
+        else    //AVR is already there
         {
-            m_iCurrentPosition = i;//Set current position to new iterated position
+            m_iGoalPosition = pos;
+            FinishMove();
+            return;
+        }
+        m_iGoalPosition = pos;
+        StartMotion();
+    }
+
+    void AVRSystem::HaltMove()
+    {
+        int truePos = GetTruePos();
+        Metrics::Record(Metrics::Histogram::MoveDuration, Now() - m_Motion.GetStartTime());
+        m_MoveTimer.stop();
+        m_DisplayTimer.stop();
+        m_TelemetryTimer.stop();
+        m_Trajectory.clear();
+        m_iCurrentPosition = truePos;   //AVR stays where it is
+        m_iGoalPosition = truePos;
+        m_State = AVR::AVRSystem::State::Idle;
+        m_Snapshot.PublishIdle(m_iCurrentPosition);
+        ShowPosition(m_iCurrentPosition, true);
+        if(m_iTelemetryInterval >= 0)
+            SendTelemetry(m_iCurrentPosition);
+        Trace::AsyncEnd("move", this, m_iMoveRequestId);
+        emit MoveHalted(m_iCurrentPosition, m_iMoveRequestId);  //Order which started the move is over
+    }
+
+    //Trajectory is executed as one order: AVR moves to every waypoint by separate move (stopping at each of them),
+    //client gets \w for every reached waypoint and one success message at the end.
+    //Waypoints are checked before AVR starts, so trajectory with wrong waypoint isn't started at all.
+    void AVRSystem::FollowTrajectory(const QVector<int>& waypoints)
+    {
+        for(int pos : waypoints)
+        {
+            if(pos < 0 || pos > m_iMaxPos)
+            {
+                MoveToPos(pos);     //Reports wrong position
+                return;
+            }
+        }
+        if(m_State == AVR::AVRSystem::State::Moving)
+        {
+            emit ErrorOccurred(AVRSystem::Error::AlreadyMoving, m_iRequestId);  //Impossible, move orders wait in queue
+            return;
+        }
+
+        m_Trajectory = waypoints;
+        m_iWaypoint = 0;
+        m_iMoveRequestId = m_iRequestId;
+        if(!StartNextWaypoint())
+            emit WorkIsComplete(m_iMoveRequestId);  //AVR was already at all waypoints
+        else
+            Trace::AsyncBegin("move", this, m_iMoveRequestId);
+    }
+
+    bool AVRSystem::StartNextWaypoint()
+    {
+        //Waypoints equal to current position are reached at once
+        while(m_iWaypoint < m_Trajectory.size() && m_Trajectory[m_iWaypoint] == m_iCurrentPosition)
+        {
+            emit WaypointReached(m_iWaypoint, m_iCurrentPosition, m_iMoveRequestId);
+            m_iWaypoint++;
+        }
+        if(m_iWaypoint >= m_Trajectory.size())
+        {
+            m_Trajectory.clear();
+            return false;
+        }
+
+        m_State = AVR::AVRSystem::State::Moving;
+        m_iGoalPosition = m_Trajectory[m_iWaypoint];
+        m_Motion = Motion(m_iCurrentPosition, m_iGoalPosition, Now(), m_Profile);
+        StartMotion();
+        return true;
+    }
+
+    //Stop interrupts current move and cancels move orders waiting for their turn,
+    //because they were given for position which AVR won't reach now.
+    void AVRSystem::Stop()
+    {
+        QVector<Message> cancelled;
+        bool wasFull = false;
+        m_Queue.TakeMoveOrders(cancelled, wasFull);
+        if(m_State == AVRSystem::State::Moving)
+            HaltMove();
+        for(const Message& msg : cancelled)
+            emit ErrorOccurred(AVRSystem::Error::Cancelled, msg.GetRequestId());
+        emit WorkIsComplete(m_iRequestId);  //AVR is standing still
+        if(wasFull)
+            emit QueueHasSpace();
+    }
+
+    void AVRSystem::OnMoveTimer()
+    {
+        m_Clock.AdvanceTo(m_Motion.FinishTime());   //Virtual clock jumps to the end of the move
+        if(!m_Motion.IsFinishedAt(Now()))   //Timer woke up a bit earlier, waiting for the rest
+        {
+            m_MoveTimer.start(m_Clock.TimerInterval(m_Motion.FinishTime()));
+            return;
+        }
+        FinishMove();
+    }
 
-            //Decreasing wait time
-            if(waitTime > minumumWaitTime)
-                waitTime *= timeDecreaseFactor;
-            else if(waitTime < minumumWaitTime) //If time is lower than minimum value
-                waitTime = minumumWaitTime;     //than it equals minimum value.
+    void AVRSystem::OnDisplayTimer()
+    {
+        ShowPosition(m_Motion.PositionAt(Now()));
+    }
 
-            emit UpdateDisplay(i);  //Sending signal to UI for updating visible position value
-            QThread::msleep(waitTime);   //Wait before next iteration
+    //Client subscribed for position updates. It gets current position at once, and then updates while AVR is moving.
+    void AVRSystem::Subscribe(int interval)
+    {
+        m_iTelemetryInterval = interval;
+        m_TelemetryTimer.stop();
+        SendTelemetry(GetTruePos());
+        if(m_State == AVRSystem::State::Moving)
+            StartTelemetry();
+    }
+
+    void AVRSystem::Unsubscribe()
+    {
+        m_iTelemetryInterval = -1;
+        m_TelemetryTimer.stop();
+    }
+
+    //Updates are sent only while moving, idle AVR doesn't send anything after final position.
+    //With fixed interval position is sent on every timeout, even if it's the same (AVR makes first step after long pause).
+    //With zero interval timer wakes up right at the moment of the next step, so every new position is sent once.
+    void AVRSystem::StartTelemetry()
+    {
+        if(m_iTelemetryInterval < 0 || m_Clock.GetMode() == Clock::Mode::Virtual)
+            return;     //Nobody is subscribed or move is over at once, final position will be sent when it's complete
+        if(m_iTelemetryInterval > 0)
+        {
+            m_TelemetryTimer.setSingleShot(false);
+            m_TelemetryTimer.start(m_iTelemetryInterval);
+        }
+        else
+        {
+            m_TelemetryTimer.setSingleShot(true);
+            m_TelemetryTimer.start(m_Clock.TimerInterval(m_Motion.NextStepTime(Now())));
         }
+    }
 
+    void AVRSystem::OnTelemetryTimer()
+    {
+        if(m_State != AVRSystem::State::Moving)
+            return;
+        int pos = m_Motion.PositionAt(Now());
+        if(m_iTelemetryInterval > 0)
+        {
+            SendTelemetry(pos);
+            return;
+        }
+        if(pos != m_iTelemetryPosition)     //Timer could wake up a bit earlier than step is made
+            SendTelemetry(pos);
+        m_TelemetryTimer.start(m_Clock.TimerInterval(m_Motion.NextStepTime(Now())));
+    }
+
+    void AVRSystem::SendTelemetry(int truePos)
+    {
+        m_iTelemetryPosition = truePos;
+        emit Telemetry(ReportedPos(truePos));
+    }
+
+    //UI is updated by queued signal from AVR thread. Sending the same value again would only cost a repaint.
+    void AVRSystem::ShowPosition(int pos, bool force)
+    {
+        if(pos == m_iDisplayedPosition && !force)
+            return;
+        m_iDisplayedPosition = pos;
+        emit UpdateDisplay(pos);
+    }
+
+    void AVRSystem::FinishMove()
+    {
+        Metrics::Record(Metrics::Histogram::MoveDuration, Now() - m_Motion.GetStartTime());
+        m_DisplayTimer.stop();
+        m_TelemetryTimer.stop();
+        m_iCurrentPosition = m_iGoalPosition;   //Goal position becomes current position
+        if(!m_Trajectory.isEmpty())     //Waypoint is reached, AVR goes on to the next one without idling
+        {
+            emit WaypointReached(m_iWaypoint, m_iCurrentPosition, m_iMoveRequestId);
+            m_iWaypoint++;
+            if(StartNextWaypoint())
+                return;
+        }
         m_State = AVR::AVRSystem::State::Idle;  //Work is complete, now system is idling.
-        emit WorkIsComplete();  //Sending signal to server for our client that work is complete
+        m_Snapshot.PublishIdle(m_iCurrentPosition);
+        ShowPosition(m_iCurrentPosition, true);    //Final position is always shown
+        if(m_iTelemetryInterval >= 0)
+            SendTelemetry(m_iCurrentPosition);  //Subscribed client gets final position before success message
+        Trace::AsyncEnd("move", this, m_iMoveRequestId);
+        emit WorkIsComplete(m_iMoveRequestId);  //Sending signal to server for our client that work is complete
 
+        DrainQueue();   //Executing orders received while we were moving until one of them starts new move
     }
 
-    //This function is not a member of AVR::AVRSystem
-    //It returns random integer value in range of two selected values
-    int RandomBetween(int min, int max)
+    //Executes queued commands. While AVR is moving only commands which are not move orders are taken,
+    //so move orders wait for the end of current move.
+    void AVRSystem::DrainQueue()
     {
-        static bool rinit = false;
-        if (!rinit)
+        TraceScope trace("drain queue");
+        m_Queue.StartTaking();  //Commands pushed from now on will wake us up again
+        Message msg;
+        bool wasFull = false;
+        bool hadSpace = false;
+        while(m_Queue.TakeNext(msg, m_State == AVRSystem::State::Moving, wasFull))
         {
-            qsrand(time(NULL));
-            rinit = true;
+            hadSpace = hadSpace || wasFull;
+            ExecuteMsg(msg);
         }
-        return qrand() % ((max + 1) - min) + min;
+        if(hadSpace)
+            emit QueueHasSpace();   //Server may have stopped reading client because of full queue
     }
 
-    //This method returns current position
+    qint64 AVRSystem::Now() const
+    {
+        return m_Clock.Now();
+    }
+
+    //Returns real position. While moving it's taken from motion model.
+    int AVRSystem::GetTruePos() const
+    {
+        if(m_State == AVRSystem::State::Moving)
+            return m_Motion.PositionAt(Now());
+        return m_iCurrentPosition;
+    }
+
+    //This method returns current position. It's called from server thread too,
+    //so it takes real position from the snapshot, not from AVR thread members.
     int AVRSystem::GetCurrentPos() const
     {
-        int ResponsePos = m_iCurrentPosition;   //Initialy returned value will equal real position
-        int toLieRoll = RandomBetween(1, 100);  //Now we getting random number between 1 and 100
+        Motion motion;
+        m_Snapshot.Read(motion);
+        return ReportedPos(motion.PositionAt(Now()));   //Idle snapshot always gives its single position
+    }
+
+    //This method decides whether AVR lies about real position. It's thread-safe too:
+    //every AVR has its own lock-free random generator, so devices never wait for each other.
+    int AVRSystem::ReportedPos(int truePos) const
+    {
+        int ResponsePos = truePos;              //Initialy returned value will equal real position
+        int toLieRoll = m_Random.Between(1, 100);    //Now we getting random number between 1 and 100
 
         //If our dice roll chance value is lower or equals system's chance to lie
         //AND current real position is not 0
         //Than we are going to lie...
-        if (toLieRoll <= m_iChanceToLie && m_iCurrentPosition > 0)
+        if (toLieRoll <= m_iChanceToLie && truePos > 0)
         {
             //Adding to response value some random number between -75 and 75
-            ResponsePos += RandomBetween(-75, 75);
+            ResponsePos += m_Random.Between(-75, 75);
             if(ResponsePos > m_iMaxPos)     //If response position exceeds maximum position...
                 ResponsePos = m_iMaxPos;    //Than it will be equal it.
 
@@ -126,30 +428,85 @@ namespace AVR
     //This slot is parsing client's messages from server
     void AVRSystem::ParseMsg(Message msg)
     {
+        TraceScope trace("ParseMsg", msg.GetRequestId());
+        bool notify = false;
+        if(!m_Queue.Push(msg, notify))  //Command goes through queue, so it keeps order with commands queued by server
+        {
+            emit ErrorOccurred(AVRSystem::Error::QueueIsFull, msg.GetRequestId());
+            return;
+        }
+        DrainQueue();
+    }
+
+    //This slot triggered when server pushed client's commands to queue
+    void AVRSystem::OnCommandsQueued()
+    {
+        DrainQueue();
+    }
+
+    //Executes client's message
+    void AVRSystem::ExecuteMsg(const Message& msg)
+    {
+        TraceScope trace("execute", msg.GetRequestId());
         Message::Type type = msg.GetMessageType();
+        m_iRequestId = msg.GetRequestId();  //Every reply below carries this ID
         switch(type)
         {
             case Message::Type::MoveForNSteps:  //If asking for move for some steps
                 //Asking for server to say client that AVR system recieved his message
-                emit MessageReceived(type, msg.GetSteps());
+                emit MessageReceived(type, msg.GetSteps(), m_iRequestId);
                 MoveToPos(m_iCurrentPosition + msg.GetSteps()); //Moving to (Current position + Number of steps)
                 break;
 
             case Message::Type::MoveToZero:
                 //Asking for server to say client that AVR system recieved his message
-                emit MessageReceived(type);
+                emit MessageReceived(type, 0, m_iRequestId);
                 MoveToZero();   //Moving to zero
                 break;
 
             case Message::Type::GetPosition:
                 //Asking for server to say client that AVR system recieved his message
-                emit MessageReceived(type);
-                emit SendPosition(GetCurrentPos()); //Returning to server position returned by GetCurrentPos()
+                emit MessageReceived(type, 0, m_iRequestId);
+                emit SendPosition(GetCurrentPos(), m_iRequestId); //Returning to server position returned by GetCurrentPos()
+                break;
+
+            case Message::Type::Subscribe:
+                if(msg.GetSteps() < 0)  //Interval can't be negative
+                {
+                    emit ErrorOccurred(AVRSystem::Error::ValueIsLowerThanZero, m_iRequestId);
+                    break;
+                }
+                emit MessageReceived(type, msg.GetSteps(), m_iRequestId);
+                Subscribe(msg.GetSteps());  //Client gets current position right after \r and then updates while moving
+                break;
+
+            case Message::Type::Unsubscribe:
+                emit MessageReceived(type, 0, m_iRequestId);
+                Unsubscribe();
+                break;
+
+            case Message::Type::Stop:
+                emit MessageReceived(type, 0, m_iRequestId);
+                Stop();
+                break;
+
+            case Message::Type::MoveTo:
+                emit MessageReceived(type, msg.GetSteps(), m_iRequestId);
+                MoveToPos(msg.GetSteps());  //Step value is goal position itself
+                break;
+
+            case Message::Type::Trajectory:
+                emit MessageReceived(type, msg.GetWaypoints().size(), m_iRequestId);  //Waypoint count is sent back
+                FollowTrajectory(msg.GetWaypoints());
+                break;
+
+            case Message::Type::Retarget:
+                Retarget(msg.GetSteps());   //Step value is new goal position, \r is sent after previous move is halted
                 break;
 
             default:
                 //If unknown message received - report about it
-                emit ErrorOccurred(AVRSystem::Error::UnknownMessage);
+                emit ErrorOccurred(AVRSystem::Error::UnknownMessage, m_iRequestId);
             }
     }
 
@@ -157,9 +514,15 @@ namespace AVR
     void AVRSystem::OnClientInitRequest()
     {
         //Send to server current position and maximum position for new client
-        //Sending new position directly from m_iCurrentPosition (not by GetCurrentPos() method)
+        //Sending new position directly from GetTruePos() (not by GetCurrentPos() method)
         //So sent position will be always true.
-        emit ClientInit(m_iCurrentPosition, m_iMaxPos);
+        emit ClientInit(GetTruePos(), m_iMaxPos);
+    }
+
+    //This slot triggered when client has been disconnected from server
+    void AVRSystem::OnClientDisconnected()
+    {
+        Unsubscribe();  //Next client has to subscribe by itself
     }
 
 }
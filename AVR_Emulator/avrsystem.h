@@ -1,8 +1,13 @@
 #pragma once
 
 #include <QObject>
-#include <QLCDNumber>
+#include <QTimer>
 #include "avrmessage.h"
+#include "avrcommandqueue.h"
+#include "avrmotion.h"
+#include "avrclock.h"
+#include "avrsnapshot.h"
+#include "avrrandom.h"
 
 namespace AVR
 {
@@ -25,15 +30,35 @@ namespace AVR
             UnknownMessage,
             ValueIsLowerThanZero,
             TooHighValue,
-            AlreadyMoving
+            AlreadyMoving,
+            QueueIsFull,
+            Cancelled
         };
 
     private:
         AVRSystem::State m_State;   //Current state of AVR system
-        int m_iCurrentPosition;     //Current position
+        int m_iCurrentPosition;     //Current position. While moving it is start position of the move, real one is given by m_Motion.
         int m_iGoalPosition;        //Goal position (future current position, becomes it when AVR finished moving)
         int m_iChanceToLie;         //Chance to lie (must be between 1 and 100)
+        mutable Random m_Random;    //Random generator for lies. Position requests take numbers from any thread.
         int m_iMaxPos;              //Maximum possible position
+        Motion m_Motion;            //Model of current move. Tells position at any moment while AVR is moving.
+        MotionProfile m_Profile;    //Acceleration profile of all moves of this AVR
+        Clock m_Clock;              //Time source for moves. Could be real, accelerated or virtual.
+        PositionSnapshot m_Snapshot;    //Copy of motion state for other threads. Published on every move start and end.
+        QTimer m_MoveTimer;         //Fires once when current move is complete
+        QTimer m_DisplayTimer;      //Fires periodicaly while moving for updating visible position value
+        int m_iDisplayedPosition;   //Last position value sent to UI
+        QTimer m_TelemetryTimer;    //Fires when it's time to send position update to subscribed client
+        int m_iTelemetryInterval;   //Interval of position updates in real milliseconds. 0 means update on every step,
+                                    //-1 means nobody is subscribed.
+        int m_iTelemetryPosition;   //Last real position sent by position update
+        quint32 m_iRequestId;       //ID of client's request being executed now. Replies to it carry this ID.
+        quint32 m_iMoveRequestId;   //ID of request which started current move. Success reply carries it.
+        QVector<int> m_Trajectory;  //Waypoints of trajectory being executed. Empty if AVR doesn't follow trajectory.
+        int m_iWaypoint;            //Index of waypoint AVR is moving to
+        CommandQueue m_Queue;       //Client's commands waiting for execution. Server pushes them from its thread.
+                                    //Move orders wait there while AVR is moving and are executed one by one.
 
         //Disallow evil constructors + default
         AVRSystem(void) = delete;
@@ -45,28 +70,73 @@ namespace AVR
         //Internal private methods
         void MoveToZero();          //Begins moving AVR position to 0
         void MoveToPos(int pos);    //Begins moving AVR position to specific position
+        void StartMotion();         //Starts timers for move described by m_Motion and publishes it to other threads
+        void FinishMove();          //Ends current move and executes pending move orders
+        void HaltMove();            //Interrupts current move. AVR stays at position it has reached.
+        void Stop();                //Stops current move and cancels queued move orders
+        void Retarget(int pos);     //Changes goal of current move. Idle AVR just moves to pos.
+        void FollowTrajectory(const QVector<int>& waypoints);  //Begins moving through waypoints one by one
+        bool StartNextWaypoint();   //Begins move to next waypoint of trajectory. Returns false if all of them are reached.
+        void ExecuteMsg(const Message& msg);  //Executes client's message immediately
+        void DrainQueue();          //Executes queued commands which can be executed now
+        void ShowPosition(int pos, bool force = false);  //Sends position to UI if it differs from displayed one
+        void Subscribe(int interval);   //Starts position updates for client. Interval is in milliseconds, 0 means every step.
+        void Unsubscribe();             //Stops position updates
+        void StartTelemetry();          //Starts position updates for current move if client is subscribed
+        void SendTelemetry(int truePos);    //Sends position update. Position may be untrue as answer to position request.
+        int ReportedPos(int truePos) const; //Returns position which AVR says. With chance of m_iChanceToLie it's wrong.
+        qint64 Now() const;         //Returns current simulated time in milliseconds
+        int GetTruePos() const;     //Returns real current AVR position. It never lies.
+
+    public:
+        //Constructor initiates AVRSystem with chance to lie, maximum position and simulation clock.
+        AVRSystem(int ChanceToLie, int MaxPos, const Clock& clock = Clock(), QObject* parent = 0);
+        ~AVRSystem();
+
+        //Sets how many times per second UI is updated while moving. Final position is always sent.
+        //0 means UI sees only start and final positions of every move. Must be called before moving to AVR thread.
+        void SetDisplayRate(int framesPerSecond);
+        //Sets seed of random generator, so AVR lies the same way in every run. By default seed is unpredictable.
+        //Must be called before moving to AVR thread.
+        void SetRandomSeed(quint64 seed);
+        //Sets acceleration profile of moves. Must be called before moving to AVR thread.
+        void SetMotionProfile(MotionProfile profile);
+
+        //Sets how many commands can wait in queue. Must be called before moving to AVR thread.
+        void SetQueueCapacity(int capacity);
+        //Returns command queue. Server pushes client's commands to it and then emits CommandsQueued.
+        CommandQueue* GetCommandQueue();
+
         int GetCurrentPos() const;  //Returns current AVR position.
                                     //With chance of m_iChanceToLie it can say wrong position.
                                     //On zero position it always says true position.
+                                    //It's lock-free and thread-safe, so server answers position requests without AVR thread.
 
-    public:
-        //Constructor initiates AVRSystem with chance to lie and maximum position.
-        AVRSystem(int ChanceToLie, int MaxPos, QObject* parent = 0);
-        ~AVRSystem();
-        
+    private slots:
+        void OnMoveTimer();         //Triggers when current move is complete
+        void OnDisplayTimer();      //Triggers when it's time to update visible position value
+        void OnTelemetryTimer();    //Triggers when it's time to send position update to subscribed client
 
     public slots:
         void ParseMsg(Message msg); //Parses incoming client's message from server.
+                                    //Move orders received while moving are queued, position requests are answered at once.
+        void OnCommandsQueued();    //Triggers when server pushed commands to queue. Executes what can be executed now.
         void OnClientInitRequest(); //Triggers when server asks for client init when it was connected.
                                     //Always sends true
+        void OnClientDisconnected();    //Triggers when client has gone. Stops position updates.
 
     signals:
-        void WorkIsComplete();        //Says to server when moving was complete.
-        void SendPosition(int pos);   //Says to server current position (calls GetCurrentPos() method)
-        void ErrorOccurred(AVRSystem::Error code); //Says to server when error occured in AVR System.
+        //All replies to client's messages carry ID of client's request, so client could match them with requests.
+        void WorkIsComplete(quint32 requestId = 0);        //Says to server when moving was complete.
+        void SendPosition(int pos, quint32 requestId = 0);   //Says to server current position (calls GetCurrentPos() method)
+        void ErrorOccurred(AVRSystem::Error code, quint32 requestId = 0); //Says to server when error occured in AVR System.
         void UpdateDisplay(int pos);  //Asks UI to update position value
-        void MessageReceived(Message::Type type, int ReceivedSteps = 0);    //Reports server that messsage from client was received (What message and how much steps).
+        void WaypointReached(int index, int pos, quint32 requestId = 0);  //Says to server that trajectory's waypoint is reached
+        void MoveHalted(int pos, quint32 requestId = 0);  //Says to server that move of this request was interrupted at true position pos
+        void Telemetry(int pos);      //Sends position update to subscribed client. It's not a reply, so it has no request ID.
+        void MessageReceived(Message::Type type, int ReceivedSteps = 0, quint32 requestId = 0);    //Reports server that messsage from client was received (What message and how much steps).
         void ClientInit(int currentPos, int maxPos);    //Sends server information for initializing client.
+        void QueueHasSpace();       //Says to server that full command queue has space again, so it can read client's commands.
     };
 
 }
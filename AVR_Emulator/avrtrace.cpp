@@ -0,0 +1,252 @@
+#include "avrtrace.h"
+#include "avrrandom.h"
+#include <QCoreApplication>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <QByteArray>
+#include <vector>
+
+namespace AVR
+{
+    std::atomic<bool> Trace::s_bOn(false);
+
+    namespace
+    {
+        enum class Phase : quint8
+        {
+            Complete,
+            AsyncBegin,
+            AsyncEnd
+        };
+
+        //Slot of ring buffer. Write() reads slots while owner thread may overwrite them, so fields are atomic,
+        //and events which could be overwritten during reading are dropped by ring head.
+        struct Slot
+        {
+            std::atomic<const char*> name;
+            std::atomic<qint64> start;
+            std::atomic<qint64> duration;
+            std::atomic<quint64> key;       //Key of async event (owner object mixed with request ID)
+            std::atomic<quint64> tag;       //Phase in high half, request ID in low one
+        };
+
+        struct Event    //Copy of slot taken by Write()
+        {
+            const char* name;
+            qint64 start;
+            qint64 duration;
+            quint64 key;
+            quint64 tag;
+        };
+
+        struct Buffer
+        {
+            int threadId;           //Track number in trace
+            QString threadName;
+            std::atomic<quint64> head;  //Count of events ever recorded. Event i is in slot i % EventsPerThread.
+            std::vector<Slot> slots;
+
+            Buffer() : threadId(0), head(0), slots(Trace::EventsPerThread)
+            {
+            }
+        };
+
+        struct Registry
+        {
+            QMutex mutex;               //Guards list. It's taken when thread records its first event and by Write().
+            QVector<Buffer*> buffers;   //Buffers of all threads which recorded something. Buffers of finished threads
+                                        //are kept, so their events are written too.
+        };
+
+        Registry& GetRegistry()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        const QElapsedTimer& Clock()
+        {
+            static const QElapsedTimer clock = []()
+            {
+                QElapsedTimer timer;
+                timer.start();
+                return timer;
+            }();
+            return clock;
+        }
+
+        thread_local Buffer* localBuffer = nullptr;
+
+        Buffer& LocalBuffer()
+        {
+            if(localBuffer)
+                return *localBuffer;
+
+            Buffer* buffer = new Buffer;
+            QThread* thread = QThread::currentThread();
+            buffer->threadName = thread->objectName();  //Host names its threads before starting them
+            {
+                Registry& registry = GetRegistry();
+                QMutexLocker locker(&registry.mutex);
+                registry.buffers.append(buffer);
+                buffer->threadId = registry.buffers.size();
+            }
+            if(buffer->threadName.isEmpty())
+            {
+                QCoreApplication* app = QCoreApplication::instance();
+                buffer->threadName = app && app->thread() == thread ? QStringLiteral("Main thread")
+                                                                    : QStringLiteral("Thread %1").arg(buffer->threadId);
+            }
+            localBuffer = buffer;
+            return *buffer;
+        }
+
+        void Record(Phase phase, const char* name, quint64 key, quint32 requestId, qint64 start, qint64 duration)
+        {
+            Buffer& buffer = LocalBuffer();
+            quint64 head = buffer.head.load(std::memory_order_relaxed);     //Only this thread changes it
+            //Reader which sees any store below sees head of this event too, so it knows this slot is being rewritten
+            std::atomic_thread_fence(std::memory_order_release);
+            Slot& slot = buffer.slots[head % Trace::EventsPerThread];
+            slot.name.store(name, std::memory_order_relaxed);
+            slot.start.store(start, std::memory_order_relaxed);
+            slot.duration.store(duration, std::memory_order_relaxed);
+            slot.key.store(key, std::memory_order_relaxed);
+            slot.tag.store(quint64(phase) << 32 | requestId, std::memory_order_relaxed);
+            buffer.head.store(head + 1, std::memory_order_release);
+        }
+
+        quint64 AsyncKey(const void* owner, quint32 requestId)
+        {
+            return Random::Mix(quint64(quintptr(owner))) ^ requestId;
+        }
+
+        QByteArray Micros(qint64 nanoseconds)   //Chrome trace timestamps are microseconds
+        {
+            QByteArray fraction = QByteArray::number(nanoseconds % 1000).rightJustified(3, '0');
+            return QByteArray::number(nanoseconds / 1000) + '.' + fraction;
+        }
+
+        QByteArray Escaped(const QString& text)
+        {
+            QByteArray result = text.toUtf8();
+            result.replace('\\', "\\\\");
+            result.replace('"', "\\\"");
+            return result;
+        }
+    }
+
+    void Trace::Start()
+    {
+        Clock();    //Clock starts before the first event
+        s_bOn.store(true, std::memory_order_relaxed);
+    }
+
+    void Trace::Stop()
+    {
+        s_bOn.store(false, std::memory_order_relaxed);
+    }
+
+    qint64 Trace::Now()
+    {
+        return Clock().nsecsElapsed();
+    }
+
+    void Trace::Complete(const char* name, quint32 requestId, qint64 start)
+    {
+        Record(Phase::Complete, name, 0, requestId, start, Now() - start);
+    }
+
+    void Trace::AsyncBegin(const char* name, const void* owner, quint32 requestId)
+    {
+        if(IsOn())
+            Record(Phase::AsyncBegin, name, AsyncKey(owner, requestId), requestId, Now(), 0);
+    }
+
+    void Trace::AsyncEnd(const char* name, const void* owner, quint32 requestId)
+    {
+        if(IsOn())
+            Record(Phase::AsyncEnd, name, AsyncKey(owner, requestId), requestId, Now(), 0);
+    }
+
+    void Trace::Write(QIODevice& out)
+    {
+        QVector<Buffer*> buffers;
+        {
+            Registry& registry = GetRegistry();
+            QMutexLocker locker(&registry.mutex);
+            buffers = registry.buffers;     //Buffers are never deleted, they can be read without lock
+        }
+
+        QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+        bool first = true;
+        auto writeEvent = [&](const QByteArray& event)
+        {
+            out.write(first ? "\n" : ",\n");
+            out.write(event);
+            first = false;
+        };
+
+        out.write("{\"traceEvents\":[");
+        std::vector<Event> events;
+        for(Buffer* buffer : buffers)
+        {
+            QByteArray tid = QByteArray::number(buffer->threadId);
+            writeEvent("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid +
+                       ",\"args\":{\"name\":\"" + Escaped(buffer->threadName) + "\"}}");
+
+            //Ring is copied first and checked after, the same way as seqlock is read
+            quint64 head = buffer->head.load(std::memory_order_acquire);
+            quint64 from = head > quint64(EventsPerThread) ? head - EventsPerThread : 0;
+            events.clear();
+            for(quint64 i = from; i < head; i++)
+            {
+                const Slot& slot = buffer->slots[i % EventsPerThread];
+                events.push_back({slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed),
+                                  slot.duration.load(std::memory_order_relaxed), slot.key.load(std::memory_order_relaxed),
+                                  slot.tag.load(std::memory_order_relaxed)});
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            //Owner thread could overwrite slots of events before this one while they were copied
+            quint64 last = buffer->head.load(std::memory_order_relaxed);
+            quint64 valid = last + 1 > quint64(EventsPerThread) ? last + 1 - EventsPerThread : 0;
+
+            for(quint64 i = qMax(from, valid); i < head; i++)
+            {
+                const Event& event = events[i - from];
+                Phase phase = Phase(event.tag >> 32);
+                QByteArray line = "{\"name\":\"" + QByteArray(event.name) + "\",\"cat\":\"avr\",\"ph\":\"";
+                if(phase == Phase::Complete)
+                    line += "X\",\"ts\":" + Micros(event.start) + ",\"dur\":" + Micros(event.duration);
+                else
+                    line += QByteArray(phase == Phase::AsyncBegin ? "b" : "e") + "\",\"id\":\"0x" +
+                            QByteArray::number(event.key, 16) + "\",\"ts\":" + Micros(event.start);
+                line += ",\"pid\":" + pid + ",\"tid\":" + tid +
+                        ",\"args\":{\"request\":" + QByteArray::number(quint32(event.tag)) + "}}";
+                writeEvent(line);
+            }
+        }
+        out.write("\n],\"displayTimeUnit\":\"ns\"}\n");
+    }
+
+    bool Trace::Dump(const QString& path, QString& error)
+    {
+        QFile file(path);
+        if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            error = "Can't open trace file " + path + ": " + file.errorString();
+            return false;
+        }
+        Write(file);
+        if(file.error() != QFileDevice::NoError)
+        {
+            error = "Can't write trace file " + path + ": " + file.errorString();
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <QtGlobal>
+#include <QString>
+#include <QIODevice>
+#include <atomic>
+
+namespace AVR
+{
+    //Opt-in tracing of request path through emulator threads. Events are written to Chrome trace format
+    //(chrome://tracing, Perfetto UI), every thread is a separate track there.
+    //Every thread records into its own ring buffer which only this thread writes, so recording takes no locks:
+    //a few relaxed stores and one release store. When buffer is full the oldest events are overwritten.
+    //Buffers are read only by Dump(). While tracing is off every call costs one relaxed load.
+    //
+    //Events tagged by request ID:
+    //  complete events (begin and end on one thread) - socket read and write, decode, command execution, reply;
+    //  async events (begin and end may be on different threads) - queue wait from server to AVR thread and move.
+    //Request IDs are counted by every client, so async events are also keyed by object which owns them
+    //(queue or AVR System), and requests of different devices don't mix.
+    class Trace
+    {
+    private:
+        static std::atomic<bool> s_bOn;
+
+    public:
+        static const int EventsPerThread = 64 * 1024;   //Size of ring buffer of every thread, power of two
+
+        static void Start();    //Turns tracing on. Events recorded before are kept.
+        static void Stop();     //Turns tracing off. Recorded events are kept for Dump().
+        static bool IsOn()
+        {
+            return s_bOn.load(std::memory_order_relaxed);
+        }
+        static qint64 Now();    //Trace clock in nanoseconds
+
+        //Recording. name must be string literal, it's stored as pointer.
+        static void Complete(const char* name, quint32 requestId, qint64 start);    //Event from start to now
+        static void AsyncBegin(const char* name, const void* owner, quint32 requestId);
+        static void AsyncEnd(const char* name, const void* owner, quint32 requestId);
+
+        //Writes events of all threads (running and finished ones) as Chrome trace JSON
+        static void Write(QIODevice& out);
+        static bool Dump(const QString& path, QString& error);  //Writes trace to file. Returns false and error if it can't.
+    };
+
+    //Complete event of scope. Nothing is recorded if tracing was off when scope started.
+    class TraceScope
+    {
+    private:
+        const char* m_pName;
+        quint32 m_iRequestId;
+        qint64 m_Start;     //-1 if tracing is off
+
+        //Disallow copying
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+    public:
+        explicit TraceScope(const char* name, quint32 requestId = 0)
+            : m_pName(name), m_iRequestId(requestId), m_Start(Trace::IsOn() ? Trace::Now() : -1)
+        {
+        }
+
+        ~TraceScope()
+        {
+            if(m_Start >= 0)
+                Trace::Complete(m_pName, m_iRequestId, m_Start);
+        }
+
+        void SetRequestId(quint32 requestId)    //For scopes which learn request ID after they started
+        {
+            m_iRequestId = requestId;
+        }
+    };
+}
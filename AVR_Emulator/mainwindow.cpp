@@ -2,60 +2,56 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include <QMessageBox>
+#include <QTimer>
+#include <stdexcept>
 
-MainWindow::MainWindow(const QHostAddress& host, int iPort, int chanceToLie, int maxPos, QWidget *parent) :
+MainWindow::MainWindow(const AVR::Settings& settings, QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow)
 {
     ui->setupUi(this); //Init Qt UI
-    //Registering our types for Qt signals
-    qRegisterMetaType<AVR::Message>("AVR::Message");
-    qRegisterMetaType<AVR::Message::Type>("Message::Type");
-    qRegisterMetaType<AVR::AVRSystem::Error>("AVRSystem::Error");
-    //Creating AVR System unit
-    avr = new AVR::AVRSystem(chanceToLie, maxPos);  //Passing chance to lie and maximum position values
+    connectedClients = 0;
+    connectedObservers = 0;
+    labelUpdatePending = false;
     try
     {
-        server = new AVR::Server(host, iPort); //Trying to create and host AVR server entity
+        //Creating AVR System units and trying to host their servers.
+        //Passing chance to lie, maximum position values and clock to every AVR System.
+        avrHost.Start(settings);
     }
-    catch(...) //If server init failed
+    catch(const std::exception& e) //If server init failed
     {
+        QMessageBox::critical(0,"Server Error",e.what());   //Show error message
         this->close();  //Exiting from applicationg.
         exit(0);
     }
     QString sHost, sPort;   //String variables for host and port
-    sHost = host.toString();
-    sPort.sprintf("%i", iPort);
+    sHost = settings.host.toString();
+    if(settings.deviceCount > 1)     //Every device has its own port
+        sPort.sprintf("%i-%i", settings.port, settings.port + settings.deviceCount - 1);
+    else
+        sPort.sprintf("%i", settings.port);
     if(sHost == "0.0.0.0")  //Set hostname to localhost if QHostName returns 0.0.0.0 (Which means "Any host").
         sHost = "localhost";
     QString hostInfo = "Host info: " + sHost + ":" + sPort;   //Creating host information sign
     ui->hostInfo->setText(hostInfo);
-    avr->moveToThread(&backgroundThread);   //Moving AVR System to separate thread
-
-    //Connecting all slots and events of AVR System and Server
-    QObject::connect(&backgroundThread, &QThread::finished, avr, &QObject::deleteLater);
-    QObject::connect(server, &AVR::Server::AVRMessage, avr, &AVR::AVRSystem::AVRSystem::ParseMsg, Qt::QueuedConnection);    //To organize queue of incoming messages in AVRSystem owned thread.
-    QObject::connect(server, &AVR::Server::ChangeConnectionLabel, this, &MainWindow::ChangeConnectionLabelToValue);
-    QObject::connect(avr, &AVR::AVRSystem::WorkIsComplete, server, &AVR::Server::AVRWorkIsComplete);
-    QObject::connect(avr, &AVR::AVRSystem::SendPosition, server, &AVR::Server::SendPosition);
-    QObject::connect(avr, &AVR::AVRSystem::ErrorOccurred, server, &AVR::Server::OnAVRError);
-    QObject::connect(avr, &AVR::AVRSystem::MessageReceived, server, &AVR::Server::OnMessageReceived);
-    QObject::connect(avr, &AVR::AVRSystem::UpdateDisplay, this, &MainWindow::OnUpdateAVRDisplay);
-    QObject::connect(avr, &AVR::AVRSystem::ClientInit, server, &AVR::Server::OnClientInit);
-    QObject::connect(server, &AVR::Server::AskForClientInit, avr, &AVR::AVRSystem::OnClientInitRequest);
 
-    //Launching AVR System's thread
-    backgroundThread.start();
+    //Connecting UI with every server. Display shows position of the first device.
+    //Servers and AVR Systems live in their own threads, UI gets only rare events: connection changes and
+    //position updates limited by display rate. So UI never delays the protocol.
+    for(int i = 0; i < avrHost.GetDeviceCount(); i++)
+    {
+        QObject::connect(avrHost.GetServer(i), &AVR::Server::ChangeConnectionLabel, this, &MainWindow::ChangeConnectionLabelToValue);
+        QObject::connect(avrHost.GetServer(i), &AVR::Server::ObserverConnected, this, &MainWindow::OnObserverConnected);
+    }
+    QObject::connect(avrHost.GetDevice(0), &AVR::AVRSystem::UpdateDisplay, this, &MainWindow::OnUpdateAVRDisplay);
 }
 
 MainWindow::~MainWindow()
 {
-    //Destroying ui, AVR System and Server objects
+    //Destroying ui, AVR Systems and Servers
     delete ui;
-    delete avr;
-    backgroundThread.quit();    //Also stopping the background thread
-    backgroundThread.wait();
-    delete server;
+    avrHost.Stop();
 }
 
 //Triggers when AVR System says UI to change position value on window
@@ -68,9 +64,42 @@ void MainWindow::OnUpdateAVRDisplay(int pos)
 //Servers sends signal to UI to change connection state lable sign
 void MainWindow::ChangeConnectionLabelToValue(bool IsConnected)
 {
-    if(IsConnected)
-        ui->connectionState->setText("<html><head/><body><p align=\"center\"><span style=\" font-weight:600; color:#00aa00;\">Client connected</span></p></body></html>");
+    connectedClients += IsConnected ? 1 : -1;
+    ScheduleConnectionLabelUpdate();
+}
+
+//When observer connected to any server (or disconnected)
+void MainWindow::OnObserverConnected(bool IsConnected)
+{
+    connectedObservers += IsConnected ? 1 : -1;
+    ScheduleConnectionLabelUpdate();
+}
+
+//Hundreds of observers could connect at once, label is repainted only once for all of them
+void MainWindow::ScheduleConnectionLabelUpdate()
+{
+    if(labelUpdatePending)
+        return;
+    labelUpdatePending = true;
+    QTimer::singleShot(100, this, &MainWindow::UpdateConnectionLabel);
+}
+
+void MainWindow::UpdateConnectionLabel()
+{
+    labelUpdatePending = false;
+    QString state;
+    if(avrHost.GetDeviceCount() > 1)   //With many devices label shows how much of them have client
+        state.sprintf("Clients connected: %i of %i", connectedClients, avrHost.GetDeviceCount());
+    else if(connectedClients > 0)
+        state = "Client connected";
     else
-        ui->connectionState->setText("<html><head/><body><p align=\"center\"><span style=\" font-weight:600; color:#aa0000;\">No connection</span></p></body></html>");
+        state = "No connection";
+    if(connectedObservers > 0)
+        state += QString(" (+%1 observers)").arg(connectedObservers);
+
+    QString text;
+    text.sprintf("<html><head/><body><p align=\"center\"><span style=\" font-weight:600; color:%s;\">%s</span></p></body></html>",
+                 connectedClients > 0 ? "#00aa00" : "#aa0000", qPrintable(state));
+    ui->connectionState->setText(text);
 }
 
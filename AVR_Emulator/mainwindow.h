@@ -2,9 +2,7 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QThread>
-#include "avrsystem.h"
-#include "avrserver.h"
+#include "avrhost.h"
 
 namespace Ui 
 {
@@ -17,18 +15,22 @@ class MainWindow : public QMainWindow
 
 private:
     Ui::MainWindow *ui;         //UI interface
-    QThread backgroundThread;   //Separate thread for AVR system
-    AVR::AVRSystem* avr;        //AVR main interface
-    AVR::Server* server;        //AVR Server entity
+    AVR::DeviceHost avrHost;    //Host of AVR systems and their servers
+    int connectedClients;       //How much devices have connected client now
+    int connectedObservers;     //How much observers are connected to all devices
+    bool labelUpdatePending;    //Connection label will be updated soon
 
 public:
     explicit MainWindow(QWidget *parent = 0);
-    MainWindow(const QHostAddress& host, int iPort, int chanceToLie, int maxPos, QWidget *parent = 0);
+    MainWindow(const AVR::Settings& settings, QWidget *parent = 0);
     ~MainWindow();
 
 private slots:
     void OnUpdateAVRDisplay(int pos);   //Triggers when AVR system asks to update UI position
     void ChangeConnectionLabelToValue(bool IsConnected);    //Changes UI label text of connection state
+    void OnObserverConnected(bool IsConnected);             //Counts observers and shows them on connection label
+    void ScheduleConnectionLabelUpdate();                   //Updates connection label once for burst of connection events
+    void UpdateConnectionLabel();                           //Sets connection label text
     
 };
 
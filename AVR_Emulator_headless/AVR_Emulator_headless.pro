@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Headless AVR emulator. Same AVR core as AVR_Emulator, but built on
+# QCoreApplication without QtWidgets, so it runs on machines without display.
+#
+#-------------------------------------------------
+
+QT       -= gui
+
+TARGET = AVR_Emulator_headless
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../AVR_Emulator/avrcore.pri)
+
+SOURCES += \
+        main.cpp
+
+DESTDIR = ../bin/emulator_headless
+OBJECTS_DIR = ../bin/emulator_headless/.obj
+MOC_DIR = ../bin/emulator_headless/.moc
+RCC_DIR = ../bin/emulator_headless/.rcc
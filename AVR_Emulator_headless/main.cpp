@@ -0,0 +1,97 @@
+#include "avrhost.h"
+#include "avrsettings.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <stdexcept>
+#ifdef Q_OS_UNIX
+#include <QSocketNotifier>
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    int signalSockets[2];   //Signal handler writes signal number to the first socket, main thread reads the second one
+
+    void OnSignal(int signal)
+    {
+        char code = char(signal);
+        ssize_t written = ::write(signalSockets[0], &code, 1);    //Nothing else is safe in signal handler
+        Q_UNUSED(written);
+    }
+}
+#endif
+
+//Headless AVR emulator. It has the same AVR System and Server as GUI emulator, but doesn't need display.
+//Errors and connection events are written to stderr.
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    //Reading host, port, maximum position, chance to lie and other values from launch arguments
+    AVR::Settings settings;
+    QString error;
+    if (!settings.ParseArguments(a.arguments(), error))
+    {
+        qCritical().noquote() << "Init Error:" << error;
+        return 1;   //Incorrect launch argument
+    }
+
+    AVR::DeviceHost host;
+    try
+    {
+        host.Start(settings);   //Creating AVR System units and hosting their servers
+    }
+    catch(const std::exception& e) //If server init failed
+    {
+        qCritical().noquote() << "Server Error:" << e.what();
+        return 1;
+    }
+
+    //Reporting about connection state changes of every device. Servers live in network threads,
+    //application object as context makes these reports go through main thread.
+    for (int i = 0; i < host.GetDeviceCount(); i++)
+    {
+        int port = settings.port + i;
+        QObject::connect(host.GetServer(i), &AVR::Server::ChangeConnectionLabel, &a, [port](bool IsConnected)
+        {
+            qInfo().noquote() << QString("Port %1: %2").arg(port).arg(IsConnected ? "client connected" : "client disconnected");
+        });
+        QObject::connect(host.GetServer(i), &AVR::Server::ObserverConnected, &a, [port](bool IsConnected)
+        {
+            qInfo().noquote() << QString("Port %1: %2").arg(port).arg(IsConnected ? "observer connected" : "observer disconnected");
+        });
+    }
+
+#ifdef Q_OS_UNIX
+    //With tracing on Ctrl+C and kill stop emulator by its event loop, so host writes trace when it's destroyed.
+    //SIGUSR1 writes trace recorded so far without stopping.
+    if (!settings.traceFile.isEmpty() && ::socketpair(AF_UNIX, SOCK_STREAM, 0, signalSockets) == 0)
+    {
+        QSocketNotifier* notifier = new QSocketNotifier(signalSockets[1], QSocketNotifier::Read, &a);
+        QObject::connect(notifier, &QSocketNotifier::activated, &a, [&]()
+        {
+            char code = 0;
+            if (::read(signalSockets[1], &code, 1) != 1)
+                return;
+            if (code != SIGUSR1)
+            {
+                a.quit();
+                return;
+            }
+            QString traceError;
+            if (host.DumpTrace(traceError))
+                qInfo().noquote() << "Trace is written to" << settings.traceFile;
+            else
+                qCritical().noquote() << "Trace Error:" << traceError;
+        });
+        std::signal(SIGINT, OnSignal);
+        std::signal(SIGTERM, OnSignal);
+        std::signal(SIGUSR1, OnSignal);
+    }
+#endif
+
+    qInfo().noquote() << QString("AVR Emulator is listening %1:%2 (%3 device(s))")
+                         .arg(settings.host.toString()).arg(settings.port).arg(settings.deviceCount);
+    return a.exec();
+}
@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# Load generator of AVR emulator. Console application, opens many
+# connections and reports throughput and latency histograms.
+#
+#-------------------------------------------------
+
+QT       -= gui
+
+TARGET = AVR_LoadGen
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../AVR_Client/avrclient.pri)
+
+SOURCES += \
+        main.cpp \
+    avrhistogram.cpp \
+    avrloadgen.cpp \
+    avrloadsettings.cpp
+
+HEADERS += \
+    avrhistogram.h \
+    avrloadgen.h \
+    avrloadsettings.h
+
+DESTDIR = ../bin/loadgen
+OBJECTS_DIR = ../bin/loadgen/.obj
+MOC_DIR = ../bin/loadgen/.moc
+RCC_DIR = ../bin/loadgen/.rcc
@@ -0,0 +1,117 @@
+#include "avrhistogram.h"
+#include <QtAlgorithms>
+
+namespace AVR
+{
+    namespace
+    {
+        const int subBucketHalfMagnitude = 10;                      //Half of sub-buckets: 1024 gives 3 significant digits
+        const qint64 subBucketCount = qint64(2) << subBucketHalfMagnitude;  //2048
+        const qint64 subBucketHalf = subBucketCount / 2;
+        const int bucketCount = 32;     //Values up to 2^42, more than a month in microseconds
+    }
+
+    const qint64 LatencyHistogram::MaxValue = (subBucketCount << (bucketCount - 1)) - 1;
+
+    LatencyHistogram::LatencyHistogram()
+    {
+        m_Counts.fill(0, int((bucketCount + 1) * subBucketHalf));
+        m_iTotal = 0;
+        m_iMin = 0;
+        m_iMax = 0;
+        m_Sum = 0;
+    }
+
+    int LatencyHistogram::IndexOf(qint64 value)
+    {
+        //Bucket is the power of two above the first sub-bucket range. Values of the first bucket are stored exactly.
+        int bucket = 63 - int(qCountLeadingZeroBits(quint64(value | (subBucketCount - 1)))) - subBucketHalfMagnitude;
+        qint64 subBucket = value >> bucket;     //Between subBucketHalf and subBucketCount, except the first bucket
+        return int((qint64(bucket) << subBucketHalfMagnitude) + subBucket);
+    }
+
+    qint64 LatencyHistogram::LowestValueAt(int index)
+    {
+        int bucket = index >> subBucketHalfMagnitude;
+        qint64 subBucket = index & (subBucketHalf - 1);
+        if (bucket == 0)    //The first bucket has all sub-buckets from 0
+            return index;
+        return (subBucketHalf + subBucket) << (bucket - 1);
+    }
+
+    qint64 LatencyHistogram::HighestValueAt(int index)
+    {
+        int bucket = index >> subBucketHalfMagnitude;
+        return LowestValueAt(index) + (bucket > 1 ? (qint64(1) << (bucket - 1)) : 1) - 1;
+    }
+
+    void LatencyHistogram::Record(qint64 value)
+    {
+        value = qBound(qint64(0), value, MaxValue);
+        m_Counts[IndexOf(value)]++;
+        if (!m_iTotal || value < m_iMin)
+            m_iMin = value;
+        if (value > m_iMax)
+            m_iMax = value;
+        m_iTotal++;
+        m_Sum += value;
+    }
+
+    void LatencyHistogram::Add(const LatencyHistogram& other)
+    {
+        if (!other.m_iTotal)
+            return;
+        for (int i = 0; i < m_Counts.size(); i++)
+            m_Counts[i] += other.m_Counts[i];
+        if (!m_iTotal || other.m_iMin < m_iMin)
+            m_iMin = other.m_iMin;
+        m_iMax = qMax(m_iMax, other.m_iMax);
+        m_iTotal += other.m_iTotal;
+        m_Sum += other.m_Sum;
+    }
+
+    void LatencyHistogram::Reset()
+    {
+        m_Counts.fill(0);
+        m_iTotal = 0;
+        m_iMin = 0;
+        m_iMax = 0;
+        m_Sum = 0;
+    }
+
+    qint64 LatencyHistogram::Count() const
+    {
+        return m_iTotal;
+    }
+
+    qint64 LatencyHistogram::Min() const
+    {
+        return m_iMin;
+    }
+
+    qint64 LatencyHistogram::Max() const
+    {
+        return m_iMax;
+    }
+
+    double LatencyHistogram::Mean() const
+    {
+        return m_iTotal ? m_Sum / m_iTotal : 0;
+    }
+
+    qint64 LatencyHistogram::ValueAtPercentile(double percentile) const
+    {
+        if (!m_iTotal)
+            return 0;
+        //Rank of sample, the first one is 1. 0 percentile is the minimum.
+        qint64 rank = qMax(qint64(1), qint64(percentile / 100 * m_iTotal + 0.5));
+        qint64 seen = 0;
+        for (int i = 0; i < m_Counts.size(); i++)
+        {
+            seen += m_Counts[i];
+            if (seen >= rank)
+                return qBound(m_iMin, HighestValueAt(i), m_iMax);
+        }
+        return m_iMax;
+    }
+}
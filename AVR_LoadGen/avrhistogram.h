@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QtGlobal>
+#include <QVector>
+
+namespace AVR
+{
+    //Latency histogram with HDR layout: values are kept with 3 significant decimal digits at any magnitude,
+    //so percentiles of microsecond and minute latencies are equally precise, and memory doesn't depend on sample count.
+    //Buckets are powers of two, every bucket is split into 1024 equal sub-buckets (2048 in the first one).
+    class LatencyHistogram
+    {
+    private:
+        QVector<qint64> m_Counts;   //Sample count of every sub-bucket
+        qint64 m_iTotal;            //Count of all samples
+        qint64 m_iMin;              //Exact minimum and maximum of samples
+        qint64 m_iMax;
+        double m_Sum;               //Sum of all samples for mean value
+
+        static int IndexOf(qint64 value);           //Returns index of sub-bucket which value belongs to
+        static qint64 LowestValueAt(int index);     //Returns range of values of sub-bucket
+        static qint64 HighestValueAt(int index);
+
+    public:
+        static const qint64 MaxValue;   //Largest value which can be recorded. Larger ones are recorded as it.
+
+        LatencyHistogram();
+
+        void Record(qint64 value);      //Adds sample, negative ones are recorded as 0
+        void Add(const LatencyHistogram& other);    //Adds all samples of another histogram
+        void Reset();
+
+        qint64 Count() const;
+        qint64 Min() const;     //Min, max and mean are 0 if histogram is empty
+        qint64 Max() const;
+        double Mean() const;
+        //Returns value which percentile (between 0 and 100) of samples are not larger than.
+        //Like in HDR histograms, it's the highest value of the sub-bucket with this sample.
+        qint64 ValueAtPercentile(double percentile) const;
+
+        //Calls visitor(value, count) for every non-empty sub-bucket in ascending order. Value is sub-bucket's highest one.
+        template<typename Visitor>
+        void ForEachBucket(Visitor visitor) const
+        {
+            for (int i = 0; i < m_Counts.size(); i++)
+                if (m_Counts[i])
+                    visitor(qMin(HighestValueAt(i), m_iMax), m_Counts[i]);
+        }
+    };
+}
@@ -0,0 +1,316 @@
+#include "avrloadgen.h"
+#include <QJsonArray>
+#include <QDebug>
+
+namespace AVR
+{
+    namespace
+    {
+        const int connectTimeout = 10000;   //Milliseconds to wait for all connections before measurement
+        const int drainTimeout = 30000;     //Milliseconds to wait for requests in flight after measurement
+        const double percentiles[] = {50, 90, 99, 99.9};
+
+        QJsonObject StatsToJson(const LoadGenerator::CommandStats& stats, double seconds)
+        {
+            QJsonObject latency;
+            latency["min"] = double(stats.latency.Min());
+            latency["mean"] = stats.latency.Mean();
+            latency["p50"] = double(stats.latency.ValueAtPercentile(50));
+            latency["p90"] = double(stats.latency.ValueAtPercentile(90));
+            latency["p99"] = double(stats.latency.ValueAtPercentile(99));
+            latency["p999"] = double(stats.latency.ValueAtPercentile(99.9));
+            latency["max"] = double(stats.latency.Max());
+
+            QJsonArray histogram;   //Pairs of sub-bucket value and sample count, histograms of runs can be merged by them
+            stats.latency.ForEachBucket([&histogram](qint64 value, qint64 count)
+            {
+                histogram.append(QJsonArray{double(value), double(count)});
+            });
+
+            QJsonObject result;
+            result["requests"] = double(stats.latency.Count());
+            result["errors"] = double(stats.errors);
+            result["rate_per_s"] = seconds > 0 ? stats.inWindow / seconds : 0;
+            result["latency_us"] = latency;
+            result["histogram_us"] = histogram;
+            return result;
+        }
+    }
+
+    LoadGenerator::LoadGenerator(const LoadSettings& settings, QObject* parent)
+        : QObject(parent),
+          m_Settings(settings)
+    {
+        m_iWindow = 0;
+        m_iReady = 0;
+        m_iFailed = 0;
+        m_iObservers = 0;
+        m_iInFlight = 0;
+        m_bRunning = false;
+        m_bFinished = false;
+        m_Deadline.setSingleShot(true);
+
+        for (int i = 0; i < m_Settings.moveWeight; i++)
+            m_Pattern.append(MoveBy);
+        for (int i = 0; i < m_Settings.zeroWeight; i++)
+            m_Pattern.append(MoveToZero);
+        for (int i = 0; i < m_Settings.positionWeight; i++)
+            m_Pattern.append(GetPosition);
+    }
+
+    const char* LoadGenerator::CommandName(Command command)
+    {
+        switch(command)
+        {
+            case MoveBy:
+                return "MoveForNSteps";
+            case MoveToZero:
+                return "MoveToZero";
+            case GetPosition:
+                return "GetPosition";
+            default:
+                return "Total";
+        }
+    }
+
+    void LoadGenerator::Start()
+    {
+        m_Connections.resize(m_Settings.connections);
+        for (int i = 0; i < m_Connections.size(); i++)
+        {
+            Connection& connection = m_Connections[i];
+            connection.client = new AsyncClient(this);
+            connection.port = m_Settings.port + i % m_Settings.deviceCount;
+            connection.position = 0;
+            connection.maxPos = 0;
+            connection.nextCommand = i % m_Pattern.size();  //Connections don't send the same commands at the same time
+            connection.inFlight = 0;
+            connection.ready = false;
+
+            QObject::connect(connection.client, &AsyncClient::Ready, this, [this, i](int currentPos, int maxPos)
+            {
+                OnReady(i, currentPos, maxPos);
+            });
+            QObject::connect(connection.client, &AsyncClient::SocketError, this,
+                             [this, i](QAbstractSocket::SocketError, const QString& text)
+            {
+                OnConnectionFailed(i, text);
+            });
+            connection.client->Connect(m_Settings.host, connection.port, m_Settings.binary);
+        }
+
+        QObject::connect(&m_Deadline, &QTimer::timeout, this, &LoadGenerator::BeginMeasurement);
+        m_Deadline.start(connectTimeout);   //Measurement starts without connections which aren't ready by then
+    }
+
+    void LoadGenerator::OnReady(int index, int currentPos, int maxPos)
+    {
+        Connection& connection = m_Connections[index];
+        connection.ready = true;
+        connection.position = currentPos;   //Initial position is always true
+        connection.maxPos = maxPos;
+        if (connection.client->IsObserver())    //Device has controller already, orders would be rejected
+            m_iObservers++;
+        m_iReady++;
+
+        if (m_bRunning)     //Connection was late, it joins measurement
+        {
+            for (int i = 0; i < m_Settings.depth; i++)
+                SendNext(index);
+        }
+        else if (m_iReady + m_iFailed >= m_Connections.size())
+            BeginMeasurement();
+    }
+
+    void LoadGenerator::OnConnectionFailed(int index, const QString& text)
+    {
+        if (m_bFinished)
+            return;
+        qWarning().noquote() << QString("Port %1: %2").arg(m_Connections[index].port).arg(text);
+        m_Connections[index].ready = false;     //Its requests in flight are counted as errors
+        m_iFailed++;
+        if (!m_bRunning && m_iReady + m_iFailed >= m_Connections.size())
+            BeginMeasurement();
+    }
+
+    void LoadGenerator::BeginMeasurement()
+    {
+        if (m_bRunning || m_bFinished)
+            return;
+        m_Deadline.stop();
+        m_Deadline.disconnect();
+        if (!m_iReady)
+        {
+            qCritical().noquote() << "Load Error: No connection to AVR emulator is ready.";
+            Finish();
+            return;
+        }
+
+        m_bRunning = true;
+        m_Timer.start();
+        QObject::connect(&m_Deadline, &QTimer::timeout, this, &LoadGenerator::EndMeasurement);
+        m_Deadline.start(m_Settings.duration * 1000);
+        for (int i = 0; i < m_Connections.size(); i++)
+            for (int j = 0; j < m_Settings.depth; j++)
+                SendNext(i);
+    }
+
+    void LoadGenerator::EndMeasurement()
+    {
+        m_bRunning = false;
+        m_iWindow = m_Timer.nsecsElapsed();
+        m_Deadline.disconnect();
+        if (!m_iInFlight)
+        {
+            Finish();
+            return;
+        }
+        //Requests which don't get reply in time are lost by disconnection
+        QObject::connect(&m_Deadline, &QTimer::timeout, this, &LoadGenerator::Finish);
+        m_Deadline.start(drainTimeout);
+    }
+
+    void LoadGenerator::Finish()
+    {
+        if (m_bFinished)
+            return;
+        m_bFinished = true;
+        m_bRunning = false;
+        m_Deadline.stop();
+        for (Connection& connection : m_Connections)
+            connection.client->Disconnect();
+        emit Finished();
+    }
+
+    void LoadGenerator::SendNext(int index)
+    {
+        Connection& connection = m_Connections[index];
+        if (!connection.ready || !connection.client->IsReady())
+            return;
+
+        Command command = GetPosition;  //Observer can only ask position
+        if (!connection.client->IsObserver())
+            command = m_Pattern[connection.nextCommand++ % m_Pattern.size()];
+        qint64 sentAt = m_Timer.nsecsElapsed();
+        ResultCallback done = [this, index, command, sentAt](const RequestResult& result)
+        {
+            OnResult(index, command, sentAt, result);
+        };
+
+        m_iInFlight++;
+        connection.inFlight++;
+        switch(command)
+        {
+            case MoveBy:
+            {
+                //Moves go forward while they fit and backward otherwise, so AVR stays in range
+                int steps = connection.position + m_Settings.steps <= connection.maxPos ? m_Settings.steps : -m_Settings.steps;
+                connection.position += steps;
+                connection.client->MoveBy(steps, done);
+                break;
+            }
+            case MoveToZero:
+                connection.position = 0;
+                connection.client->MoveToZero(done);
+                break;
+            default:
+                connection.client->GetPosition(done);
+        }
+    }
+
+    void LoadGenerator::OnResult(int index, Command command, qint64 sentAt, const RequestResult& result)
+    {
+        Connection& connection = m_Connections[index];
+        m_iInFlight--;
+        connection.inFlight--;
+
+        CommandStats& stats = m_Stats[command];
+        if (result.status == RequestStatus::Success || result.status == RequestStatus::Halted)
+        {
+            stats.latency.Record((m_Timer.nsecsElapsed() - sentAt) / 1000);
+            if (m_bRunning)
+                stats.inWindow++;
+        }
+        else
+            stats.errors++;
+
+        if (m_bFinished)
+            return;
+        if (m_bRunning)
+            SendNext(index);
+        else if (!m_iInFlight)
+            Finish();
+    }
+
+    void LoadGenerator::PrintReport(QTextStream& out) const
+    {
+        double seconds = m_iWindow / 1e9;
+        int lastPort = m_Settings.port + qMin(m_Settings.connections, m_Settings.deviceCount) - 1;
+        out << QString("AVR load: %1 connection(s) to %2:%3, %4 protocol, depth %5, mix move:%6 zero:%7 position:%8")
+               .arg(m_Settings.connections).arg(m_Settings.host)
+               .arg(lastPort > m_Settings.port ? QString("%1-%2").arg(m_Settings.port).arg(lastPort) : QString::number(m_Settings.port))
+               .arg(m_Settings.binary ? "binary" : "text").arg(m_Settings.depth)
+               .arg(m_Settings.moveWeight).arg(m_Settings.zeroWeight).arg(m_Settings.positionWeight) << "\n";
+        out << QString("Measured %1 s. Ready connections: %2 (%3 observer), failed: %4.")
+               .arg(seconds, 0, 'f', 2).arg(m_iReady).arg(m_iObservers).arg(m_iFailed) << "\n\n";
+
+        out << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10")
+               .arg("Command", -14).arg("Requests", 10).arg("Errors", 8).arg("Rate/s", 11).arg("Min", 9)
+               .arg("p50", 9).arg("p90", 9).arg("p99", 9).arg("p999", 9).arg("Max", 9) << "\n";
+
+        CommandStats total;
+        for (int i = 0; i <= COMMAND_MAX; i++)
+        {
+            const CommandStats& stats = i < COMMAND_MAX ? m_Stats[i] : total;
+            if (i < COMMAND_MAX)
+            {
+                total.latency.Add(stats.latency);
+                total.errors += stats.errors;
+                total.inWindow += stats.inWindow;
+            }
+            QString line = QString("%1 %2 %3 %4 %5").arg(CommandName(Command(i)), -14)
+                           .arg(stats.latency.Count(), 10).arg(stats.errors, 8)
+                           .arg(seconds > 0 ? stats.inWindow / seconds : 0, 11, 'f', 1).arg(stats.latency.Min(), 9);
+            for (double percentile : percentiles)
+                line += QString(" %1").arg(stats.latency.ValueAtPercentile(percentile), 9);
+            line += QString(" %1").arg(stats.latency.Max(), 9);
+            out << line << "\n";
+        }
+        out << "Latencies are in microseconds." << "\n";
+    }
+
+    QJsonObject LoadGenerator::ToJson() const
+    {
+        double seconds = m_iWindow / 1e9;
+
+        QJsonObject settings;
+        settings["host"] = m_Settings.host;
+        settings["port"] = m_Settings.port;
+        settings["devices"] = m_Settings.deviceCount;
+        settings["connections"] = m_Settings.connections;
+        settings["depth"] = m_Settings.depth;
+        settings["duration_s"] = m_Settings.duration;
+        settings["steps"] = m_Settings.steps;
+        settings["protocol"] = m_Settings.binary ? "binary" : "text";
+        settings["mix"] = QJsonObject{{"move", m_Settings.moveWeight}, {"zero", m_Settings.zeroWeight},
+                                      {"position", m_Settings.positionWeight}};
+
+        QJsonObject commands;
+        CommandStats total;
+        for (int i = 0; i < COMMAND_MAX; i++)
+        {
+            commands[CommandName(Command(i))] = StatsToJson(m_Stats[i], seconds);
+            total.latency.Add(m_Stats[i].latency);
+            total.errors += m_Stats[i].errors;
+            total.inWindow += m_Stats[i].inWindow;
+        }
+        commands[CommandName(COMMAND_MAX)] = StatsToJson(total, seconds);
+
+        QJsonObject report;
+        report["settings"] = settings;
+        report["measured_s"] = seconds;
+        report["connections"] = QJsonObject{{"ready", m_iReady}, {"observers", m_iObservers}, {"failed", m_iFailed}};
+        report["commands"] = commands;
+        return report;
+    }
+}
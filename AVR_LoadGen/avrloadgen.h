@@ -0,0 +1,84 @@
+#pragma once
+
+#include <QObject>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QJsonObject>
+#include <QTextStream>
+#include "avrasyncclient.h"
+#include "avrhistogram.h"
+#include "avrloadsettings.h"
+
+namespace AVR
+{
+    //Closed-loop load generator. Every connection keeps the same number of requests in flight: the next request
+    //is sent when reply to previous one comes. Latency is time from sending request till its last reply.
+    class LoadGenerator : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        enum Command    //Commands of load mix
+        {
+            MoveBy,
+            MoveToZero,
+            GetPosition,
+            COMMAND_MAX
+        };
+
+        struct CommandStats
+        {
+            LatencyHistogram latency;   //Latencies of successful requests in microseconds
+            qint64 errors = 0;          //Requests answered with error or lost by disconnection
+            qint64 inWindow = 0;        //Requests complete during measurement, they give throughput
+        };
+
+    private:
+        struct Connection
+        {
+            AsyncClient* client;
+            int port;
+            int position;       //Expected position of AVR, it keeps relative moves in range
+            int maxPos;
+            int nextCommand;    //Index in command pattern
+            int inFlight;
+            bool ready;
+        };
+
+        LoadSettings m_Settings;
+        QVector<Connection> m_Connections;
+        QVector<Command> m_Pattern;     //Commands in proportion of mix weights. Connections go through it in turn.
+        CommandStats m_Stats[COMMAND_MAX];
+        QElapsedTimer m_Timer;          //Started when measurement starts
+        QTimer m_Deadline;              //Connection timeout, then measurement end, then drain timeout
+        qint64 m_iWindow;               //Measurement time in nanoseconds
+        int m_iReady;                   //Connections which got AVR position
+        int m_iFailed;                  //Connections which were closed by error
+        int m_iObservers;               //Connections which can only ask position
+        int m_iInFlight;                //Requests of all connections in flight
+        bool m_bRunning;                //Are new requests sent
+        bool m_bFinished;
+
+        void OnReady(int index, int currentPos, int maxPos);
+        void OnConnectionFailed(int index, const QString& text);
+        void BeginMeasurement();
+        void EndMeasurement();
+        void Finish();
+        void SendNext(int index);   //Sends next command of mix by connection
+        void OnResult(int index, Command command, qint64 sentAt, const RequestResult& result);
+
+    public:
+        LoadGenerator(const LoadSettings& settings, QObject* parent = 0);
+
+        void Start();   //Opens connections. Measurement starts when all of them are ready.
+
+        void PrintReport(QTextStream& out) const;   //Human-readable report
+        QJsonObject ToJson() const;                 //The same report with full histograms
+
+        static const char* CommandName(Command command);
+
+    signals:
+        void Finished();    //All requests are complete or lost, connections are closed
+    };
+}
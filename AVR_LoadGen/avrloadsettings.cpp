@@ -0,0 +1,169 @@
+#include "avrloadsettings.h"
+
+namespace AVR
+{
+    bool LoadSettings::ParseArguments(const QStringList& args, QString& error)
+    {
+        QString item;   //For iterated strings of arguments
+
+        //Means that argument of next iteration will be value of this option
+        bool nextIsHost = false, nextIsPort = false, nextIsDevices = false, nextIsConnections = false, nextIsDepth = false, nextIsDuration = false, nextIsSteps = false, nextIsMix = false, nextIsJson = false;
+        for (int i = 1; i < args.size(); i++)    //Arguments iteration, the first one is program name
+        {
+            item = args.at(i);  //Get argument value
+
+            if (nextIsHost)
+            {
+                host = item;
+                nextIsHost = false;
+                continue;
+            }
+
+            if (nextIsPort)
+            {
+                port = item.toInt();
+                nextIsPort = false;
+                continue;
+            }
+
+            if (nextIsDevices)
+            {
+                deviceCount = item.toInt();
+                if (deviceCount < 1 || deviceCount > 10000)
+                {
+                    error = "Incorrect device count has been passed. This value must be between 1 and 10000.";
+                    return false;
+                }
+                nextIsDevices = false;
+                continue;
+            }
+
+            if (nextIsConnections)
+            {
+                connections = item.toInt();
+                if (connections < 1 || connections > 10000)
+                {
+                    error = "Incorrect connection count has been passed. This value must be between 1 and 10000.";
+                    return false;
+                }
+                nextIsConnections = false;
+                continue;
+            }
+
+            if (nextIsDepth)
+            {
+                depth = item.toInt();
+                if (depth < 1 || depth > 100000)
+                {
+                    error = "Incorrect request depth has been passed. This value must be between 1 and 100000.";
+                    return false;
+                }
+                nextIsDepth = false;
+                continue;
+            }
+
+            if (nextIsDuration)
+            {
+                duration = item.toInt();
+                if (duration < 1 || duration > 86400)
+                {
+                    error = "Incorrect duration has been passed. This value must be between 1 and 86400 seconds.";
+                    return false;
+                }
+                nextIsDuration = false;
+                continue;
+            }
+
+            if (nextIsSteps)
+            {
+                steps = item.toInt();
+                if (steps < 1 || steps > 100000)
+                {
+                    error = "Incorrect step count has been passed. This value must be between 1 and 100000.";
+                    return false;
+                }
+                nextIsSteps = false;
+                continue;
+            }
+
+            if (nextIsMix)  //Comma-separated list of <command>:<weight>, commands which are not listed aren't sent
+            {
+                moveWeight = zeroWeight = positionWeight = 0;
+                for (const QString& part : item.split(','))
+                {
+                    QStringList pair = part.split(':');
+                    bool isNumber = false;
+                    int weight = pair.size() == 2 ? pair[1].toInt(&isNumber) : 0;
+                    if (!isNumber || weight < 0 || weight > 1000)
+                    {
+                        error = "Incorrect command mix has been passed. It must be list like move:1,zero:1,position:8 with weights between 0 and 1000.";
+                        return false;
+                    }
+                    if (pair[0] == "move")
+                        moveWeight = weight;
+                    else if (pair[0] == "zero")
+                        zeroWeight = weight;
+                    else if (pair[0] == "position")
+                        positionWeight = weight;
+                    else
+                    {
+                        error = "Incorrect command mix has been passed. Commands must be move, zero or position.";
+                        return false;
+                    }
+                }
+                if (moveWeight + zeroWeight + positionWeight == 0)
+                {
+                    error = "Incorrect command mix has been passed. At least one command must have positive weight.";
+                    return false;
+                }
+                nextIsMix = false;
+                continue;
+            }
+
+            if (nextIsJson)
+            {
+                jsonPath = item;
+                nextIsJson = false;
+                continue;
+            }
+
+            if (item == "-host")
+                nextIsHost = true;
+            else if (item == "-port")
+                nextIsPort = true;
+            else if (item == "-devices")
+                nextIsDevices = true;
+            else if (item == "-connections")
+                nextIsConnections = true;
+            else if (item == "-depth")
+                nextIsDepth = true;
+            else if (item == "-duration")
+                nextIsDuration = true;
+            else if (item == "-steps")
+                nextIsSteps = true;
+            else if (item == "-mix")
+                nextIsMix = true;
+            else if (item == "-json")
+                nextIsJson = true;
+            else if (item == "-binary")
+                binary = true;
+            else
+            {
+                error = QString("Unknown launch argument '%1'.").arg(item);
+                return false;
+            }
+        }
+
+        if (nextIsHost || nextIsPort || nextIsDevices || nextIsConnections || nextIsDepth || nextIsDuration || nextIsSteps || nextIsMix || nextIsJson)
+        {
+            error = "Launch argument value is missing.";
+            return false;
+        }
+        if (port < 1 || port + deviceCount - 1 > 65535)    //Every device has its own port
+        {
+            error = "Incorrect port has been passed. Ports of all devices must be between 1 and 65535.";
+            return false;
+        }
+        return true;
+    }
+}
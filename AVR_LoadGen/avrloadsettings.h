@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QStringList>
+
+namespace AVR
+{
+    //Launch settings of AVR load generator. Default values are used if launch argument wasn't passed.
+    struct LoadSettings
+    {
+        QString host = "127.0.0.1";     //Host of AVR emulator
+        int port = 28338;               //Port of the first device
+        int deviceCount = 1;            //How much devices to load. Their ports follow the first one as in emulator.
+        int connections = 1;            //Connections to open, they are spread over devices in turn
+        int depth = 1;                  //Requests in flight on every connection
+        int duration = 10;              //Measurement time in seconds
+        int steps = 10;                 //Step count of MoveForNSteps orders
+        int moveWeight = 1;             //Command mix: MoveForNSteps, MoveToZero and GetPosition
+        int zeroWeight = 1;             //are sent in proportion to their weights
+        int positionWeight = 8;
+        bool binary = false;            //Ask emulator for binary protocol
+        QString jsonPath;               //File for JSON report, "-" means stdout. Empty means no JSON.
+
+        //Reads settings from launch arguments. Returns false and error description if any argument is incorrect.
+        bool ParseArguments(const QStringList& args, QString& error);
+    };
+}
@@ -0,0 +1,46 @@
+#include "avrloadgen.h"
+#include "avrloadsettings.h"
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QFile>
+#include <QDebug>
+
+//Load generator of AVR emulator. It opens many connections, sends mix of commands as fast as replies come
+//and reports throughput and latency percentiles of every command.
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    AVR::LoadSettings settings;
+    QString error;
+    if (!settings.ParseArguments(a.arguments(), error))
+    {
+        qCritical().noquote() << "Init Error:" << error;
+        return 1;   //Incorrect launch argument
+    }
+
+    AVR::LoadGenerator generator(settings);
+    QObject::connect(&generator, &AVR::LoadGenerator::Finished, &a, [&]()
+    {
+        QTextStream out(stdout);
+        if (settings.jsonPath == "-")   //JSON goes to stdout instead of table
+            out << QJsonDocument(generator.ToJson()).toJson();
+        else
+        {
+            generator.PrintReport(out);
+            if (!settings.jsonPath.isEmpty())
+            {
+                QFile file(settings.jsonPath);
+                if (file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+                    file.write(QJsonDocument(generator.ToJson()).toJson());
+                else
+                    qCritical().noquote() << "Report Error: Can't write JSON report to" << settings.jsonPath;
+            }
+        }
+        out.flush();
+        a.quit();
+    }, Qt::QueuedConnection);   //Report is written when clients are done with their signals
+
+    generator.Start();
+    return a.exec();
+}
@@ -27,11 +27,15 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
         main.cpp \
         mainwindow.cpp \
-    client.cpp
+    client.cpp \
+    logmodel.cpp
 
 HEADERS += \
         mainwindow.h \
-    client.h
+    client.h \
+    logmodel.h
+
+include(../AVR_Client/avrclient.pri)
 
 FORMS += \
         mainwindow.ui
@@ -1,16 +1,32 @@
 #include "client.h"
-#include <QDataStream>
 
 namespace AVR
 {
     Client::Client(QObject* pwgt /*=0*/)    //Client constructor, initializing class members
         : QObject(pwgt),
-          m_nNextBlockSize(0)
+          m_Client(this)
     {
-        m_bConnected = false;
-        m_pTcpSocket = nullptr;
         m_iTrueAVRPosition = 0;
         m_iMaxPos = 0;
+        m_bUseBinary = false;
+
+        //Every reply of AVR is written to log
+        QObject::connect(&m_Client, &AsyncClient::Connected, this, &Client::OnConnected);
+        QObject::connect(&m_Client, &AsyncClient::ProtocolChosen, this, &Client::OnProtocolChosen);
+        QObject::connect(&m_Client, &AsyncClient::SocketError, this, &Client::OnSocketError);
+        QObject::connect(&m_Client, &AsyncClient::Ready, this, &Client::OnInit);
+        QObject::connect(&m_Client, &AsyncClient::OrderReceived, this, &Client::OnReceived);
+        QObject::connect(&m_Client, &AsyncClient::PositionReceived, this, &Client::OnPosition);
+        QObject::connect(&m_Client, &AsyncClient::MoveComplete, this, &Client::OnSuccess);
+        QObject::connect(&m_Client, &AsyncClient::MoveHalted, this, &Client::OnHalted);
+        QObject::connect(&m_Client, &AsyncClient::WaypointReached, this, &Client::OnWaypointReached);
+        QObject::connect(&m_Client, &AsyncClient::ErrorReceived, this, &Client::OnError);
+        QObject::connect(&m_Client, &AsyncClient::ObserverMode, this, &Client::OnObserver);
+        QObject::connect(&m_Client, &AsyncClient::TextMessage, this, &Client::WriteLineToLog);
+        QObject::connect(&m_Client, &AsyncClient::UnknownReply, this, &Client::WriteLineToLog);
+        QObject::connect(&m_Client, &AsyncClient::RequestComplete, this, &Client::RequestComplete);
+        //Position updates are too frequent for log, so position goes straight to UI
+        QObject::connect(&m_Client, &AsyncClient::PositionUpdated, this, &Client::PositionUpdated);
     }
 
     Client::~Client()
@@ -18,47 +34,83 @@ namespace AVR
         Disconnect();   //Disconnect and clean-up
     }
 
-    void Client::Connect(const QString& strHost, int nPort) //Connects client to AVR host
+    void Client::Connect(const QString& strHost, int nPort, bool binaryProtocol) //Connects client to AVR host
     {
-        if (m_bConnected)
+        if (m_Client.IsConnected())
             Disconnect();   //Interrupt and clean-up current connection if it exists before creating new.
 
+        m_bUseBinary = binaryProtocol;
         emit SetConnectItemEnabled(false);  //Disable 'Connect' item in menu for safe work
-        m_pTcpSocket = new QTcpSocket(this);    //Creating new socket
-        m_bConnected = true;    //Changing connected state to true
-        m_pTcpSocket->connectToHost(strHost, nPort);    //Connecting new socket to host
-
-        //Connecting socket's signals with Client's clots (connected, ready to read and error occurred signals)
-        QObject::connect(m_pTcpSocket, &QTcpSocket::connected, this, &Client::slotConnected);
-        QObject::connect(m_pTcpSocket, &QTcpSocket::readyRead, this, &Client::slotReadyRead);
-        QObject::connect(m_pTcpSocket,
-            static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error),
-            this, &Client::slotError);
+        m_Client.Connect(strHost, nPort, binaryProtocol);
     }
 
-    void Client::slotReadyRead()    //This slot triggers by QTcpSocket::readyRead signal. Processes all incoming messages.
+    void Client::Disconnect(bool writeToLog)    //Disconnect from host and clean-up client data
     {
-        QDataStream in(m_pTcpSocket);   //Init socket data stream
-        in.setVersion(QDataStream::Qt_5_3); //Sets version of QDataStream
-        while(true) //Reading incoming data in loop
+        if (m_Client.IsConnected())   //Do not clean-up if disconnected already
         {
-            if (!m_nNextBlockSize)  //Break if no data to read
-            {
-                if (m_pTcpSocket->bytesAvailable() < qint64(sizeof(quint16)))
-                    break;
-                in >> m_nNextBlockSize;
-            }
-            if (m_pTcpSocket->bytesAvailable() < m_nNextBlockSize)
-                break;
-
-            QString str;
-            in >> str;  //Write data from socket to string
-            HandleServerMessage(str);   //Parse received data
-            m_nNextBlockSize = 0;
+            if (writeToLog)
+                emit WriteLineToLog("Disconnecting from AVR.");
+            m_Client.Disconnect();
+            m_iTrueAVRPosition = 0;
+            m_iMaxPos = 0;
         }
+        //Blocking controls and allow user to connect again
+        emit SetConnectItemEnabled(true);
+        emit SetDisconnectItemEnabled(false);
+        emit SetAVRControlsEnabled(false);
+    }
+
+    bool Client::IsConnected() const
+    {
+        return m_Client.IsConnected();
+    }
+
+    bool Client::IsObserver() const
+    {
+        return m_Client.IsObserver();
+    }
+
+    int Client::GetRequestsInFlight() const
+    {
+        return m_Client.GetRequestsInFlight();
+    }
+
+    quint32 Client::slotSendToServer(MessageType msg, int steps)   //Sends message to AVR host
+    {
+        return m_Client.Send(msg, steps);
+    }
+
+    quint32 Client::SendTrajectory(const QVector<int>& waypoints)
+    {
+        return m_Client.FollowTrajectory(waypoints);
+    }
+
+    void Client::WriteReplyToLog(quint32 requestId, const QString& text)
+    {
+        if (requestId)
+            emit WriteLineToLog(QStringLiteral("[#%1] %2").arg(requestId).arg(text));
+        else
+            emit WriteLineToLog(text);
+    }
+
+    void Client::OnConnected()    //When socket connected
+    {
+        emit WriteLineToLog("Connection established successfully!");    //Write to log about it
+        emit SetDisconnectItemEnabled(true);                            //Allow user to disconnect after connection
     }
 
-    void Client::slotError(QAbstractSocket::SocketError err)    //When socket error occurred
+    // Server answered what protocol and request IDs it supports
+    void Client::OnProtocolChosen(bool binary, bool requestIds)
+    {
+        if(binary)
+            emit WriteLineToLog("AVR: Binary protocol is on.");
+        else if(m_bUseBinary)
+            emit WriteLineToLog("AVR: Binary protocol isn't supported. Using text protocol.");
+        if(!requestIds)
+            emit WriteLineToLog("AVR: Request IDs aren't supported. Replies will be matched by arrival order.");
+    }
+
+    void Client::OnSocketError(QAbstractSocket::SocketError err, const QString& text)    //When socket error occurred
     {
         QString strError;
         if (err == QAbstractSocket::HostNotFoundError)
@@ -68,161 +120,124 @@ namespace AVR
         else if (err == QAbstractSocket::ConnectionRefusedError)
             strError = "Client Error: The connection was refused.";
         else
-            strError = "Client Error: " + QString(m_pTcpSocket->errorString()); //Other socket errors
+            strError = "Client Error: " + text; //Other socket errors
         emit WriteLineToLog(strError);  //Write error information to log
         Disconnect(false);  //Close connection and clean-up client data
     }
 
-    void Client::slotSendToServer(MessageType msg, int steps)   //Sends message to AVR host
+    // AVR already has controlling client. We'll see replies to its orders too, they don't match our requests.
+    void Client::OnObserver()
     {
-        QString FullMessage;
-        if (msg == MessageType::MoveForNSteps)          //Write step quantity into message string
-            FullMessage.sprintf("%i:%i", int(msg), steps);   //if going to send MoveForNSteps message
-        else
-            FullMessage.sprintf("%i", int(msg));   //Otherwise just write the message code.
+        emit WriteLineToLog("AVR: This connection is observer. Only position requests are allowed.");
+    }
 
-        //Preparing message for sending through socket
-        QByteArray arrBlock;
-        QDataStream out(&arrBlock, QIODevice::WriteOnly);
-        out.setVersion(QDataStream::Qt_5_2);
-        out << quint16(0) << FullMessage;   //Stream our message to byte array block
-        out.device()->seek(0);
-        out << quint16(arrBlock.size() - sizeof(quint16));
-        m_pTcpSocket->write(arrBlock);  //Write prepared data to socket
+    // AVR saying it's current position.
+    // this position may be untrue with some random probability.
+    // but if position is 0 - it's always return true position.
+    void Client::OnPosition(quint32 requestId, int pos)
+    {
+        emit WriteLineToLog(QStringLiteral("----------------------------"));
+        WriteReplyToLog(requestId, QStringLiteral("AVR: Current position: %1").arg(pos));  //Saying received position
+        if(pos == m_iTrueAVRPosition)   //Comparing localy calculated AVR position with received
+            emit WriteLineToLog(QStringLiteral("This position is true."));  //If they equal the position is true.
+        else    //If not - AVR is lying.
+            emit WriteLineToLog(QStringLiteral("AVR is lying! Position must be: %1").arg(m_iTrueAVRPosition));
+        emit WriteLineToLog(QStringLiteral("----------------------------"));
     }
 
-    void Client::slotConnected()    //When socket connected
+    // AVR reporting about successfuly finished move operation.
+    void Client::OnSuccess(quint32 requestId)
     {
-        emit WriteLineToLog("Connection established successfully!");    //Write to log about it
-        emit SetDisconnectItemEnabled(true);                            //Allow user to disconnect after connection
+        WriteReplyToLog(requestId, QStringLiteral("AVR: Success! Moving has been complete."));
     }
 
-    void Client::Disconnect(bool writeToLog)    //Disconnect from host and clean-up client data
+    // AVR reached waypoint of trajectory. It's not the last reply, success comes after the last waypoint.
+    void Client::OnWaypointReached(quint32 requestId, int index, int pos)
     {
-        if (m_bConnected)   //Do not clean-up if disconnected already
-        {
-            if (writeToLog)
-                emit WriteLineToLog("Disconnecting from AVR.");
-            m_pTcpSocket->close();  //Closing socket
-            m_pTcpSocket->deleteLater();    //Asking him for self-delete
-            //Nulling client data
-            m_pTcpSocket = nullptr;
-            m_bConnected = false;
-            m_iTrueAVRPosition = 0;
-            m_iMaxPos = 0;
-        }
-        //Blocking controls and allow user to connect again
-        emit SetConnectItemEnabled(true);
-        emit SetDisconnectItemEnabled(false);
-        emit SetAVRControlsEnabled(false);
+        m_iTrueAVRPosition = pos;   //AVR stopped exactly at waypoint
+        WriteReplyToLog(requestId, QStringLiteral("AVR: Waypoint %1 reached at position %2.").arg(index + 1).arg(pos));
     }
 
-    bool Client::IsConnected() const
+    // AVR interrupted the move of this request. Position is true, so we know where AVR is now.
+    void Client::OnHalted(quint32 requestId, int pos)
+    {
+        m_iTrueAVRPosition = pos;
+        WriteReplyToLog(requestId, QStringLiteral("AVR: Moving has been interrupted at position %1.").arg(pos));
+    }
+
+    // AVR initializing client data when it was connected. Position sent with this message is ALWAYS true.
+    void Client::OnInit(int currentPos, int maxPos)
     {
-        return m_bConnected;    //Returns connected state
+        m_iTrueAVRPosition = currentPos;    //Save true AVR position into client member variable.
+        m_iMaxPos = maxPos;                 //Save max pos too
+
+        //Report about it
+        QString str;
+        str.sprintf("AVR: Current position is %i. Max position is %i.", m_iTrueAVRPosition, m_iMaxPos);
+
+        //Now we know initial position of AVR system and maximum threshold of steps.
+        //Client is ready, unlocking AVR controls for user.
+        emit WriteLineToLog(str);
+        emit WriteLineToLog("AVR: Ready for work.");
+        emit SetAVRControlsEnabled(true);
     }
 
-    void Client::HandleServerMessage(const QString& message)    //Parses messages from AVR host
+    // AVR says it received client's message and it's going to execute it.
+    void Client::OnReceived(quint32 requestId, int code, int steps, bool hasSteps)
     {
-        QString str, tmp;
-        str = message;      //Save it
-        int pos, delimiterPos;
-        if (str[0] != '\\') //Check if special AVR message token exists (\p, \r, \m, etc.)
+        if(code == int(MessageType::MoveForNSteps))   //Code 1 means callback for AVR::MessageType::MoveForNSteps request
         {
-             emit WriteLineToLog("Unknown server message: " + str);
-             return;   //Do nothing if unknown message was received.
-        }
+            if(hasSteps)
+            {
+                //Predicting will AVR move for such quantity of steps or not.
+                if(m_iTrueAVRPosition + steps <= m_iMaxPos && m_iTrueAVRPosition + steps > 0)
+                    m_iTrueAVRPosition += steps; //If it will - add it to local AVR position.
 
-        switch(str[1].toLatin1())   //Parsing message token
+                //Saying what AVR is going to do.
+                WriteReplyToLog(requestId, QStringLiteral("AVR: Received new order. Moving for %1 steps...").arg(steps));
+            }
+            else
+                WriteReplyToLog(requestId, QStringLiteral("AVR: Received new order. Moving for unknown steps..."));
+        }
+        else if(code == int(MessageType::MoveToZero)) //Code 2 means callback for AVR::MessageType::MoveToZero request
         {
-            case 'p':   // "\p" token means AVR saying it's current position.
-                        // this position may be untrue with some random probability.
-                        // but if position is 0 - it's always return true position.
-
-                pos = str.right(str.length() - 2).toInt();  //Position number comes after \p , saving it to pos
-                emit WriteLineToLog("----------------------------");
-                str.sprintf("AVR: Current position: %i", pos);  //Saying received position
-                emit WriteLineToLog(str);
-                if(pos == m_iTrueAVRPosition)   //Comparing localy calculated AVR position with received
-                    emit WriteLineToLog("This position is true.");  //If they equal the position is true.
-                else
-                {   //If not - AVR is lying.
-                    str.sprintf("AVR is lying! Position must be: %i", m_iTrueAVRPosition);
-                    emit WriteLineToLog(str);
-                }
-                emit WriteLineToLog("----------------------------");
-                break;
-
-            case 'm':   // "\m" token means text message. It writes to log everything after \m in received message.
-                str = str.right(str.length() - 2);
-                emit WriteLineToLog(str);
-                break;
-
-            case 's':   // "\s" token means AVR reporting about successfuly finished move operation.
-                emit WriteLineToLog("AVR: Success! Moving has been complete.");
-                break;
-
-            case 'i':   // "\i" token means AVR initializing client data when it was connected Client entity (not user) must to know
-                        // current position and maximum position value. Message with this token comes instantly
-                        // after client connects to AVR host. Position sent with this token is ALWAYS true.
-                        // Example of message:      \i200:15000    It means current position is 200 and max is 15000.
-
-                str = str.right(str.length() - 2);  //Remove token from string
-                delimiterPos = str.indexOf(":", 0); //Find ':' delimiter pos
-                tmp = str.left(delimiterPos);       //Save all string before delimiter (this is current pos)
-                m_iTrueAVRPosition = tmp.toInt();   //Save true AVR position into client member variable.
-                tmp = str.right(str.length() - (delimiterPos + 1)); //Get max pos
-                m_iMaxPos = tmp.toInt();            //Save it too
-
-                //Report about it
-                str.sprintf("AVR: Current position is %i. Max position is %i.", m_iTrueAVRPosition, m_iMaxPos);
-
-                //Now we know initial position of AVR system and maximum threshold of steps.
-                //Client is ready, unlocking AVR controls for user.
-                emit WriteLineToLog(str);
-                emit WriteLineToLog("AVR: Ready for work.");
-                emit SetAVRControlsEnabled(true);
-                break;
-
-            case 'r': // "\r" means AVR says it received client's message and it's going to execute it.
-                      // E.g. we requested to move for certain quantity of steps and when AVR receives
-                      // this message it says back that it's goind to do it and says how much steps client requested.
-                      // Message example:      \r1:56    This means that we requested to move for some steps (code 1)
-                      //                                 and quantity of steps is 56.
-                      // other messages does not have any second value.
-
-                str = str.right(str.length() - 2);  //Removing token from string
-                if(str[0] == '1')   //Code 1 means callback for AVR::MessageType::MoveForNSteps request
-                {
-                    if(str[1] == ':' && str[2] != '\0')
-                    {
-                        pos = str.right(str.length() - 2).toInt();  //Saving received position
-
-                        //Predicting will AVR move for such quantity of steps or not.
-                        if(m_iTrueAVRPosition + pos <= m_iMaxPos && m_iTrueAVRPosition + pos > 0)
-                            m_iTrueAVRPosition += pos; //If it will - add it to local AVR position.
-
-                        //Saying what AVR is going to do.
-                        str.sprintf("AVR: Received new order. Moving for %i steps...", pos);
-                        emit WriteLineToLog(str);
-                    }
-                    else
-                        emit WriteLineToLog("AVR: Received new order. Moving for unknown steps...");
-                }
-                else if(str[0] == '2') //Code 2 means callback for AVR::MessageType::MoveToZero request
-                {
-                    m_iTrueAVRPosition = 0; //So position is going to be nulled. Seting local position to 0.
-                    emit WriteLineToLog("AVR: Received new order. Moving to zero...");
-                }
-                else if(str[0] == '3') //Code 3 means AVR going to tell us it's position.
-                    emit WriteLineToLog("AVR: Received new order. Returning current position...");
-                else    //Undefined behavior
-                    emit WriteLineToLog("AVR: Received unknown order. Doing nothing.");
-            break;
-
-            default:    //If unknown token was received from server.
-                str.sprintf("Unknown responce token '\\%c'", str[1].toLatin1());
-                emit WriteLineToLog(str);
+            m_iTrueAVRPosition = 0; //So position is going to be nulled. Seting local position to 0.
+            WriteReplyToLog(requestId, QStringLiteral("AVR: Received new order. Moving to zero..."));
         }
+        else if(code == int(MessageType::GetPosition)) //Code 3 means AVR going to tell us it's position.
+            WriteReplyToLog(requestId, QStringLiteral("AVR: Received new order. Returning current position..."));
+        else if(code == int(MessageType::Subscribe)) //Code 4 means AVR is going to send position updates
+        {
+            if(steps > 0)
+                WriteReplyToLog(requestId, QStringLiteral("AVR: Position updates are on. Interval is %1 ms.").arg(steps));
+            else
+                WriteReplyToLog(requestId, QStringLiteral("AVR: Position updates are on. Every step is reported."));
+        }
+        else if(code == int(MessageType::Unsubscribe)) //Code 5 means AVR stopped position updates
+            WriteReplyToLog(requestId, QStringLiteral("AVR: Position updates are off."));
+        else if(code == int(MessageType::Stop)) //Code 6 means AVR is going to stop
+            WriteReplyToLog(requestId, QStringLiteral("AVR: Received new order. Stopping..."));
+        else if(code == int(MessageType::Retarget)) //Code 7 means AVR is going to another goal
+        {
+            if(hasSteps && steps >= 0 && steps <= m_iMaxPos)
+                m_iTrueAVRPosition = steps; //AVR will stop at new goal
+            WriteReplyToLog(requestId, QStringLiteral("AVR: Received new order. Moving to position %1 instead...").arg(steps));
+        }
+        else if(code == int(MessageType::MoveTo)) //Code 8 means AVR is going to certain position
+        {
+            if(hasSteps && steps >= 0 && steps <= m_iMaxPos)
+                m_iTrueAVRPosition = steps;
+            WriteReplyToLog(requestId, QStringLiteral("AVR: Received new order. Moving to position %1...").arg(steps));
+        }
+        else if(code == int(MessageType::Trajectory)) //Code 9 means AVR is going through waypoints
+            WriteReplyToLog(requestId, QStringLiteral("AVR: Received new order. Following trajectory of %1 waypoints...").arg(steps));
+        else    //Undefined behavior
+            WriteReplyToLog(requestId, QStringLiteral("AVR: Received unknown order. Doing nothing."));
+    }
+
+    // AVR error. Error is the last reply to request.
+    void Client::OnError(quint32 requestId, const QString& text)
+    {
+        WriteReplyToLog(requestId, TextProtocol::ErrorPrefix + text);
     }
 }
@@ -1,51 +1,60 @@
 #pragma once
 
 #include <QObject>
-#include <QTcpSocket>
+#include <QVector>
+#include "avrasyncclient.h"
 
 namespace AVR
 {
-    enum class MessageType    //All possible messages
-    {
-        Unknown,
-        MoveForNSteps,
-        MoveToZero,
-        GetPosition,
-        TYPE_MAX
-    };
-
-    // AVR Client class. This class works with AVR connection, sends, receives and parses it's messages.
+    // AVR Client class. It drives AVR by asynchronous client library and writes every reply to log of main form.
     class Client : public QObject
     {
         Q_OBJECT
 
      private:
-        QTcpSocket* m_pTcpSocket;   //Connection socket
-        quint16 m_nNextBlockSize;   //Socket's next block size
-        bool m_bConnected;          //Connection state of client (connected or not)
+        AsyncClient m_Client;       //Connection with AVR, it parses all replies
         int m_iTrueAVRPosition;     //Position of AVR. Calculated by client. Initialy requested from server.
         int m_iMaxPos;              //Maximum available AVR position. Initialy requested from server.
+        bool m_bUseBinary;          //Did client ask server for binary protocol
 
-        void HandleServerMessage(const QString& message);   //Method for parsing incoming messages from server.
+        void WriteReplyToLog(quint32 requestId, const QString& text);  //Writes reply to log, marked with request ID if it exists
+
+        //Handlers of AVR client signals. requestId is ID of request this is reply to, 0 if server didn't send it.
+        void OnConnected();
+        void OnProtocolChosen(bool binary, bool requestIds);
+        void OnSocketError(QAbstractSocket::SocketError err, const QString& text);
+        void OnInit(int currentPos, int maxPos);
+        void OnReceived(quint32 requestId, int code, int steps, bool hasSteps);
+        void OnPosition(quint32 requestId, int pos);
+        void OnSuccess(quint32 requestId);
+        void OnHalted(quint32 requestId, int pos);
+        void OnWaypointReached(quint32 requestId, int index, int pos);
+        void OnError(quint32 requestId, const QString& text);
+        void OnObserver();
 
     public:
         Client(QObject* pwgt = 0);
         ~Client();
 
-        void Connect(const QString& strHost, int nPort);    //Connects client to AVR host
+        //Connects client to AVR host. If binaryProtocol is true client asks server for binary protocol,
+        //and stays on text protocol if server doesn't support it.
+        void Connect(const QString& strHost, int nPort, bool binaryProtocol = false);
         void Disconnect(bool writeToLog = true);            //Disconnect from AVR host. If writeToLog == false it wouldn't log this.
         bool IsConnected() const;   //Checks current connection state
-
-    private slots:
-        void slotReadyRead();       //This slot triggers by QTcpSocket::readyRead signal. Processes all incoming messages.
-        void slotError(QAbstractSocket::SocketError err);   //Triggers when any error happens on QTcpSocket.
-        void slotConnected();      //Triggered when connected to AVR host.
+        bool IsObserver() const;    //Checks whether connection is read-only. Observer sees all replies of controlling client.
+        int GetRequestsInFlight() const;    //Returns count of sent requests which are not complete yet
 
     public slots:
-        void slotSendToServer(MessageType msg, int steps);    //Sends action message to AVR and quantity of steps if needed.
+        //Sends action message to AVR and quantity of steps if needed. It doesn't wait for reply,
+        //so many messages could be sent at once. Returns request ID (0 if server doesn't support request IDs).
+        quint32 slotSendToServer(MessageType msg, int steps);
+        //Sends trajectory: AVR moves to every waypoint one by one and reports each of them. Returns request ID as above.
+        quint32 SendTrajectory(const QVector<int>& waypoints);
 
     signals:
-        void WriteLineToLog(const QString& text);   //Writes new line directly to textEdit widget on main form
+        void WriteLineToLog(const QString& text);   //Writes new line to log on main form
+        void RequestComplete(quint32 requestId);    //Says that request got its last reply (\s, \p or error)
+        void PositionUpdated(int pos);  //Position update from AVR after subscription. It may be untrue as position reply.
 
         //This sets enabled state of widgets on main form (Connect, Disconnect and AVR Controls)
         void SetAVRControlsEnabled(bool isEnabled);
@@ -0,0 +1,95 @@
+#include "logmodel.h"
+#include <QTextStream>
+
+namespace AVR
+{
+    namespace
+    {
+        const int frameInterval = 16;   //Milliseconds between view updates (about 60 per second)
+    }
+
+    LogModel::LogModel(int capacity, QObject* parent)
+        : QAbstractListModel(parent),
+          m_FlushTimer(this)
+    {
+        m_Lines.resize(qMax(capacity, 1));
+        m_iFirst = 0;
+        m_iCount = 0;
+        m_FlushTimer.setSingleShot(true);
+        m_FlushTimer.setInterval(frameInterval);
+        QObject::connect(&m_FlushTimer, &QTimer::timeout, this, &LogModel::Flush);
+    }
+
+    const QString& LogModel::Line(int row) const
+    {
+        return m_Lines[(m_iFirst + row) % m_Lines.size()];
+    }
+
+    int LogModel::rowCount(const QModelIndex& parent) const
+    {
+        return parent.isValid() ? 0 : m_iCount;     //It's a list, rows have no children
+    }
+
+    QVariant LogModel::data(const QModelIndex& index, int role) const
+    {
+        if(role != Qt::DisplayRole || !index.isValid() || index.row() >= m_iCount)
+            return QVariant();
+        return Line(index.row());
+    }
+
+    void LogModel::Append(const QString& line)
+    {
+        m_Pending.append(line);
+        if(!m_FlushTimer.isActive())    //First line of this frame
+            m_FlushTimer.start();
+    }
+
+    void LogModel::Flush()
+    {
+        m_FlushTimer.stop();
+        if(m_Pending.isEmpty())
+            return;
+
+        int capacity = m_Lines.size();
+        int skipped = qMax(m_Pending.size() - capacity, 0);     //Batch larger than log keeps only its last lines
+        int incoming = m_Pending.size() - skipped;
+        int overflow = qMax(m_iCount + incoming - capacity, 0); //The oldest lines give place to new ones
+        if(overflow)
+        {
+            beginRemoveRows(QModelIndex(), 0, overflow - 1);
+            m_iFirst = (m_iFirst + overflow) % capacity;    //Their slots are overwritten below
+            m_iCount -= overflow;
+            endRemoveRows();
+        }
+
+        beginInsertRows(QModelIndex(), m_iCount, m_iCount + incoming - 1);
+        for(int i = skipped; i < m_Pending.size(); i++)
+        {
+            m_Lines[(m_iFirst + m_iCount) % capacity] = m_Pending[i];
+            m_iCount++;
+        }
+        endInsertRows();
+        m_Pending.clear();
+    }
+
+    void LogModel::Clear()
+    {
+        m_FlushTimer.stop();
+        m_Pending.clear();
+        beginResetModel();
+        m_Lines.fill(QString());
+        m_iFirst = 0;
+        m_iCount = 0;
+        endResetModel();
+    }
+
+    bool LogModel::Save(QIODevice& device)
+    {
+        Flush();    //Lines of current frame are saved too
+        QTextStream stream(&device);
+        for(int row = 0; row < m_iCount; row++)
+            stream << Line(row) << '\n';
+        stream.flush();
+        return stream.status() == QTextStream::Ok;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QStringList>
+#include <QVector>
+#include <QTimer>
+#include <QIODevice>
+
+namespace AVR
+{
+    //Log of main form. It keeps only the last lines in ring buffer, so memory doesn't grow in long sessions,
+    //and list view shows it by rows, drawing only visible ones.
+    //Appended lines wait in batch and go to view once per frame, so burst of replies costs one view update.
+    class LogModel : public QAbstractListModel
+    {
+        Q_OBJECT
+
+    private:
+        QVector<QString> m_Lines;   //Ring buffer of lines. Its size is log capacity.
+        int m_iFirst;               //Index of the oldest line in ring buffer
+        int m_iCount;               //Count of lines in ring buffer
+        QStringList m_Pending;      //Lines appended since last flush
+        QTimer m_FlushTimer;        //Flushes pending lines once per frame
+
+        const QString& Line(int row) const;     //Returns line by row number counted from the oldest one
+
+    public:
+        static const int DefaultCapacity = 100000;  //Lines kept in log
+
+        LogModel(int capacity = DefaultCapacity, QObject* parent = 0);
+
+        int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+        QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+        //Writes all lines to device one by one, without building whole log in memory. Returns false if write failed.
+        bool Save(QIODevice& device);
+
+    public slots:
+        void Append(const QString& line);   //Adds line. It's shown at the next frame.
+        void Clear();
+        void Flush();                       //Moves pending lines to ring buffer and view right now
+    };
+}
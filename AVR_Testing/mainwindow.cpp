@@ -4,6 +4,7 @@
 #include <QIntValidator>
 #include <QFileDialog>
 #include <QFile>
+#include <QScrollBar>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -16,13 +17,29 @@ MainWindow::MainWindow(QWidget *parent) :
     qRegisterMetaType<AVR::MessageType>("AVR::MessageType");    //Register message enum type
     ui->inputSteps->setValidator(new QIntValidator(-100000, 100000, this)); //Set bounds for step input edit
     client = new AVR::Client(0);    //Creating client entity
+    logModel = new AVR::LogModel(AVR::LogModel::DefaultCapacity, this);   //Log keeps only the last lines
+    ui->outputLog->setModel(logModel);
+    followLog = true;
 
     //Connecting our signals and slots
     QObject::connect(this, &MainWindow::SendData, client, &AVR::Client::slotSendToServer);
     QObject::connect(client, &AVR::Client::SetAVRControlsEnabled, this, &MainWindow::OnSetAVRControlsEnabled);
     QObject::connect(client, &AVR::Client::SetConnectItemEnabled, ui->actionConnect, &QAction::setEnabled);
     QObject::connect(client, &AVR::Client::SetDisconnectItemEnabled, ui->actionDisconnect, &QAction::setEnabled);
-    QObject::connect(client, &AVR::Client::WriteLineToLog, ui->outputText, &QTextEdit::append);
+    QObject::connect(client, &AVR::Client::WriteLineToLog, logModel, &AVR::LogModel::Append);
+    QObject::connect(client, &AVR::Client::PositionUpdated, this, &MainWindow::OnPositionUpdated);
+
+    //Log follows new lines only while it's scrolled to the bottom, so user can read older ones in peace
+    QObject::connect(logModel, &AVR::LogModel::rowsAboutToBeInserted, this, [this]()
+    {
+        QScrollBar* bar = ui->outputLog->verticalScrollBar();
+        followLog = bar->value() == bar->maximum();
+    });
+    QObject::connect(logModel, &AVR::LogModel::rowsInserted, this, [this]()
+    {
+        if(followLog)
+            ui->outputLog->scrollToBottom();
+    });
 }
 
 MainWindow::~MainWindow()
@@ -36,14 +53,14 @@ void MainWindow::on_MoveToPos_clicked() //When clicked Move button (move for cer
 {
     if(!client->IsConnected())  //Safety check. Return if no connection.
     {
-        ui->outputText->append("Client Error: No connection. Please, connect to AVR.");
+        logModel->Append("Client Error: No connection. Please, connect to AVR.");
         return;
     }
 
     int steps = ui->inputSteps->text().toInt(); //Get steps from input
     QString info;
     info.sprintf("Ordering AVR move for %i steps...", steps);
-    ui->outputText->append(info);
+    logModel->Append(info);
     emit SendData(AVR::MessageType::MoveForNSteps, steps);  //Emit client to send MoveForNSteps message
 }
 
@@ -51,11 +68,11 @@ void MainWindow::on_MoveToZero_clicked()    //Says AVR move it's position to zer
 {
     if(!client->IsConnected())  //Safety check. Return if no connection.
     {
-        ui->outputText->append("Client Error: No connection. Please, connect to AVR.");
+        logModel->Append("Client Error: No connection. Please, connect to AVR.");
         return;
     }
 
-    ui->outputText->append("Ordering AVR move to zero position...");
+    logModel->Append("Ordering AVR move to zero position...");
     emit SendData(AVR::MessageType::MoveToZero);    //Emit client to send MoveToZero message
 }
 
@@ -63,17 +80,105 @@ void MainWindow::on_AskPosition_clicked()
 {
     if(!client->IsConnected())  //Safety check. Return if no connection.
     {
-        ui->outputText->append("Client Error: No connection. Please, connect to AVR.");
+        logModel->Append("Client Error: No connection. Please, connect to AVR.");
         return;
     }
 
-    ui->outputText->append("Asking AVR for its position...");
+    logModel->Append("Asking AVR for its position...");
     emit SendData(AVR::MessageType::GetPosition);    //Emit client to send GetPosition message
 }
 
+void MainWindow::on_Stop_clicked()  //Says AVR to stop at once
+{
+    if(!client->IsConnected())  //Safety check. Return if no connection.
+    {
+        logModel->Append("Client Error: No connection. Please, connect to AVR.");
+        return;
+    }
+
+    logModel->Append("Ordering AVR to stop...");
+    emit SendData(AVR::MessageType::Stop);    //Emit client to send Stop message
+}
+
+void MainWindow::on_Retarget_clicked()  //Changes goal of current move. Input value is goal position, not step count.
+{
+    if(!client->IsConnected())  //Safety check. Return if no connection.
+    {
+        logModel->Append("Client Error: No connection. Please, connect to AVR.");
+        return;
+    }
+
+    int pos = ui->inputSteps->text().toInt(); //Get goal position from input
+    QString info;
+    info.sprintf("Ordering AVR to move to position %i instead...", pos);
+    logModel->Append(info);
+    emit SendData(AVR::MessageType::Retarget, pos);  //Emit client to send Retarget message
+}
+
+void MainWindow::on_MoveToGoal_clicked()    //Says AVR move to position from input
+{
+    if(!client->IsConnected())  //Safety check. Return if no connection.
+    {
+        logModel->Append("Client Error: No connection. Please, connect to AVR.");
+        return;
+    }
+
+    int pos = ui->inputSteps->text().toInt(); //Get goal position from input
+    QString info;
+    info.sprintf("Ordering AVR move to position %i...", pos);
+    logModel->Append(info);
+    emit SendData(AVR::MessageType::MoveTo, pos);  //Emit client to send MoveTo message
+}
+
+void MainWindow::on_RunTrajectory_clicked() //Says AVR move through waypoints from input
+{
+    if(!client->IsConnected())  //Safety check. Return if no connection.
+    {
+        logModel->Append("Client Error: No connection. Please, connect to AVR.");
+        return;
+    }
+
+    QVector<int> waypoints;
+    for(const QString& item : ui->inputWaypoints->text().split(',', QString::SkipEmptyParts))
+    {
+        bool ok = false;
+        waypoints.append(item.trimmed().toInt(&ok));
+        if(!ok)
+        {
+            logModel->Append("Client Error: Waypoints must be integers separated by commas.");
+            return;
+        }
+    }
+    if(waypoints.isEmpty())
+    {
+        logModel->Append("Client Error: Trajectory has no waypoints.");
+        return;
+    }
+
+    logModel->Append(QString("Ordering AVR to follow trajectory of %1 waypoints...").arg(waypoints.size()));
+    client->SendTrajectory(waypoints);
+}
+
+void MainWindow::on_positionUpdates_toggled(bool checked)    //Subscribes for position updates or unsubscribes
+{
+    if(!client->IsConnected())  //Unchecked by disconnect, nothing to say to AVR
+        return;
+
+    if(checked)
+    {
+        logModel->Append("Asking AVR for position updates...");
+        emit SendData(AVR::MessageType::Subscribe, ui->updateInterval->value());
+    }
+    else
+    {
+        logModel->Append("Asking AVR to stop position updates...");
+        emit SendData(AVR::MessageType::Unsubscribe);
+    }
+}
+
 void MainWindow::on_actionConnect_triggered()   //Says client to connect. Host and port are taken from Connection data tab inputs.
 {
-    client->Connect(ui->serverHost->text(), ui->serverPort->text().toInt());
+    client->Connect(ui->serverHost->text(), ui->serverPort->text().toInt(), ui->binaryProtocol->isChecked());
 }
 
 void MainWindow::on_actionDisconnect_triggered()    //Says client to disconnect
@@ -83,7 +188,7 @@ void MainWindow::on_actionDisconnect_triggered()    //Says client to disconnect
 
 void MainWindow::on_actionClear_triggered()     //Clear our log
 {
-    ui->outputText->clear();
+    logModel->Clear();
 }
 
 void MainWindow::on_actionSave_to_file_triggered()  //Saving our log to file
@@ -91,14 +196,13 @@ void MainWindow::on_actionSave_to_file_triggered()  //Saving our log to file
     //Calls file save dialog and return file name with it's full path
     //when file selected and Save button was clicked.
     QString fileName = QFileDialog::getSaveFileName(this, "Save output log ", "", "Text log file (*.log);;All Files (*)");
+    if(fileName.isEmpty())  //Dialog was cancelled
+        return;
+
     QFile file(fileName);   //Create file interface for working with selected file
-    if (file.open(QIODevice::ReadWrite))    //Write to file if it was successfuly opened.
-    {
-        QTextStream stream(&file);  //Connect file with text stream
-        stream << ui->outputText->toPlainText() << endl;    //Write to the file through stream.
-    }
-    else    //Report about error if file.Open() was failed.
-        QMessageBox::critical(0,"Save file error","Unable to save file.");
+    //Write to file line by line if it was successfuly opened. Old content of file is replaced.
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || !logModel->Save(file))
+        QMessageBox::critical(0,"Save file error","Unable to save file.");  //Report about error if open or write failed.
 }
 
 void MainWindow::on_actionAbout_triggered() //Shows information about application
@@ -120,5 +224,25 @@ void MainWindow::OnSetAVRControlsEnabled(bool isEnabled)    //Enables or disable
     ui->MoveToPos->setEnabled(isEnabled);
     ui->MoveToZero->setEnabled(isEnabled);
     ui->AskPosition->setEnabled(isEnabled);
+    ui->Stop->setEnabled(isEnabled);
+    ui->Retarget->setEnabled(isEnabled);
+    ui->MoveToGoal->setEnabled(isEnabled);
+    ui->RunTrajectory->setEnabled(isEnabled);
+    ui->inputWaypoints->setEnabled(isEnabled);
     ui->inputSteps->setEnabled(isEnabled);
+    ui->positionUpdates->setEnabled(isEnabled);
+    ui->updateInterval->setEnabled(isEnabled);
+    if(!isEnabled)
+    {
+        //New connection starts without subscription
+        ui->positionUpdates->blockSignals(true);
+        ui->positionUpdates->setChecked(false);
+        ui->positionUpdates->blockSignals(false);
+        ui->livePosition->setText("-");
+    }
+}
+
+void MainWindow::OnPositionUpdated(int pos)
+{
+    ui->livePosition->setNum(pos);
 }
@@ -3,6 +3,7 @@
 
 #include <QMainWindow>
 #include "client.h"
+#include "logmodel.h"
 
 namespace Ui
 {
@@ -21,6 +22,11 @@ private slots:
     void on_MoveToPos_clicked();
     void on_MoveToZero_clicked();
     void on_AskPosition_clicked();
+    void on_Stop_clicked();
+    void on_Retarget_clicked();
+    void on_MoveToGoal_clicked();
+    void on_RunTrajectory_clicked();
+    void on_positionUpdates_toggled(bool checked);
     void on_actionConnect_triggered();
     void on_actionDisconnect_triggered();
     void on_actionClear_triggered();
@@ -29,6 +35,7 @@ private slots:
     void on_actionAbout_Qt_triggered();
 
     void OnSetAVRControlsEnabled(bool isEnabled);   //Enables AVR controls on main form when client signals
+    void OnPositionUpdated(int pos);                //Shows position update from AVR
 
 signals:
     void SendData(AVR::MessageType msg, int steps = 0); //Signals client to send data
@@ -36,6 +43,8 @@ signals:
 private:
     Ui::MainWindow *ui;
     AVR::Client* client;    //Pointer to client entity
+    AVR::LogModel* logModel;    //Lines of log shown by outputLog view
+    bool followLog;             //Log was scrolled to the bottom before new lines came
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <QtGlobal>
+#include <QtEndian>
+#include <QString>
+
+/*
+    Binary AVR protocol. It's shared by AVR Emulator and its clients.
+
+    Every connection starts with text protocol (see avrserver.cpp). Client can ask for binary protocol
+    by sending text message \v<Version>, e.g. \v2. If server supports it, it answers \v2:<DeviceID> with text
+    protocol and all next messages in both directions are binary records. Otherwise server answers \v1:<DeviceID> (\v1 if
+    it's too old for request IDs, or error message if it's too old to know \v token) and connection stays on text protocol.
+
+    Every binary message is fixed-size record of RecordSize bytes, all numbers are little-endian:
+
+        Offset  Size  Field
+        0       1     Opcode
+        1       1     Flags (must be 0)
+        2       2     Device ID (index of AVR device in emulator host)
+        4       4     Request ID (0 if not used). Replies to request carry its ID.
+        8       4     First argument
+        12      4     Second argument
+
+    Records are encoded and decoded in place, without any heap allocations.
+
+    Trajectory is the only message longer than one record. Its first record has opcode Trajectory and waypoint count
+    in first argument. It's followed by TrajectoryPoints records with the same request ID, two waypoints per record
+    (second argument of the last one is unused if count is odd). Server executes trajectory when all waypoints came.
+*/
+
+namespace AVR
+{
+    namespace Protocol
+    {
+        const int TextVersion = 1;      //Version of legacy text protocol
+        const int BinaryVersion = 2;    //Version of binary protocol
+        const int RecordSize = 16;      //Size of every binary record in bytes
+        const int MaxWaypoints = 1024;  //Largest waypoint count of one trajectory
+
+        enum class Opcode : quint8
+        {
+            //Client to server. Values are the same as AVR message types.
+            MoveForNSteps = 1,  //First argument is step count
+            MoveToZero = 2,
+            GetPosition = 3,
+            Subscribe = 4,      //First argument is update interval in milliseconds, 0 means on every position change
+            Unsubscribe = 5,
+            Stop = 6,
+            Retarget = 7,       //First argument is new goal position
+            MoveTo = 8,         //First argument is goal position
+            Trajectory = 9,     //First argument is waypoint count. Waypoints come in next records.
+            TrajectoryPoints = 10,  //Next two waypoints of trajectory
+
+            //Server to client
+            Init = 0x80,        //Same as \i token. Arguments are current (always true) and maximum positions.
+            Received = 0x81,    //Same as \r token. Arguments are message type and step count.
+            Position = 0x82,    //Same as \p token. Argument is position (may be untrue).
+            Success = 0x83,     //Same as \s token.
+            Error = 0x84,       //Same as AVR Error text message. Argument is error code.
+            Telemetry = 0x85,   //Same as \t token. Argument is position (may be untrue).
+            Halted = 0x86,      //Same as \h token. Argument is position where move was interrupted (always true).
+            WaypointReached = 0x87  //Same as \w token. Arguments are waypoint index and its position.
+        };
+
+        enum class ErrorCode : qint32
+        {
+            //Errors of AVR System, values are the same as AVR::AVRSystem::Error
+            UnknownMessage = 0,
+            ValueIsLowerThanZero = 1,
+            TooHighValue = 2,
+            AlreadyMoving = 3,
+            QueueIsFull = 4,
+            Cancelled = 5,
+
+            //Errors of protocol
+            WrongDevice = 64,   //Record was addressed to another device
+            ReadOnlySession = 65,   //Observer connection tried to give order to AVR
+            WrongTrajectory = 66    //Trajectory has no waypoints, too many of them or its records are broken
+        };
+
+        //All error codes, e.g. for finding code of error text
+        const ErrorCode ErrorCodes[] = {ErrorCode::UnknownMessage, ErrorCode::ValueIsLowerThanZero, ErrorCode::TooHighValue,
+                                        ErrorCode::AlreadyMoving, ErrorCode::QueueIsFull, ErrorCode::Cancelled,
+                                        ErrorCode::WrongDevice, ErrorCode::ReadOnlySession, ErrorCode::WrongTrajectory};
+
+        //Description of error. Text protocol has no error codes, server sends this text instead and client finds
+        //code by it, so both of them take it from here.
+        inline QString ErrorText(ErrorCode code)
+        {
+            switch(code)
+            {
+                case ErrorCode::UnknownMessage:
+                    return QStringLiteral("Unknown type of incoming message.");
+                case ErrorCode::ValueIsLowerThanZero:
+                    return QStringLiteral("Requested position is lower than 0.");
+                case ErrorCode::TooHighValue:
+                    return QStringLiteral("Requested position is too large and exceeds the maximum value.");
+                case ErrorCode::AlreadyMoving:
+                    return QStringLiteral("Unexpected behavior. Attempting to move while AVR already moving. Operation canceled.");
+                case ErrorCode::QueueIsFull:
+                    return QStringLiteral("AVR is busy, command queue is full.");
+                case ErrorCode::Cancelled:
+                    return QStringLiteral("Move order was cancelled by stop order.");
+                case ErrorCode::WrongDevice:
+                    return QStringLiteral("Message was addressed to another device.");
+                case ErrorCode::ReadOnlySession:
+                    return QStringLiteral("Observer can't give orders to AVR.");
+                case ErrorCode::WrongTrajectory:
+                    return QStringLiteral("Trajectory must have from 1 to %1 waypoints.").arg(MaxWaypoints);
+                default:
+                    return QStringLiteral("Unknown error occured.");
+            }
+        }
+
+        struct Record
+        {
+            Opcode opcode;
+            quint16 device;
+            qint32 arg0;
+            qint32 arg1;
+            quint32 requestId;
+        };
+
+        inline void Encode(const Record& record, uchar* out)    //Writes record to RecordSize bytes buffer
+        {
+            out[0] = uchar(record.opcode);
+            out[1] = 0;
+            qToLittleEndian<quint16>(record.device, out + 2);
+            qToLittleEndian<quint32>(record.requestId, out + 4);
+            qToLittleEndian<qint32>(record.arg0, out + 8);
+            qToLittleEndian<qint32>(record.arg1, out + 12);
+        }
+
+        inline Record Decode(const uchar* in)   //Reads record from RecordSize bytes buffer
+        {
+            Record record;
+            record.opcode = Opcode(in[0]);
+            record.device = qFromLittleEndian<quint16>(in + 2);
+            record.requestId = qFromLittleEndian<quint32>(in + 4);
+            record.arg0 = qFromLittleEndian<qint32>(in + 8);
+            record.arg1 = qFromLittleEndian<qint32>(in + 12);
+            return record;
+        }
+    }
+}
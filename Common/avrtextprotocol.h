@@ -0,0 +1,300 @@
+#pragma once
+
+#include <QtGlobal>
+#include <QtEndian>
+#include <QString>
+#include <QByteArray>
+
+/*
+    In-place parsing of AVR text protocol. It's shared by AVR Emulator and its clients.
+
+    Text message is sent as block: quint16 block size followed by QString serialized by QDataStream
+    (quint32 size in bytes, than UTF-16 big-endian characters). Messages are parsed right in received bytes
+    through MessageView, without creating QString and without any heap allocations.
+    Outgoing messages are encoded by AppendMessage right in sender's output buffer.
+    See avrserver.cpp for description of message tokens.
+
+    Any command may end with request ID: #<RequestID>, e.g. 1:56#17. ID is unsigned 32-bit number without sign,
+    command with malformed ID is unknown message. Replies to this command (\r, \p, \s and
+    error messages) end with the same #17, so client can have many commands in flight and match replies
+    which come out of order. Commands without request ID get replies without it.
+*/
+
+namespace AVR
+{
+    namespace TextProtocol
+    {
+        const int MaxBlockSize = 16 * 1024; //Longest block which is parsed in place. Only long trajectories come close to it.
+        const char ErrorPrefix[] = "AVR Error: ";   //Error text message is \m<ErrorPrefix><Text of Protocol::ErrorText()>
+
+        //View of text message inside received block. It doesn't own or copy data.
+        class MessageView
+        {
+        private:
+            const uchar* m_pData;   //First byte of first character
+            int m_iLength;          //Length in characters
+
+        public:
+            MessageView() : m_pData(nullptr), m_iLength(0) {}
+            MessageView(const uchar* data, int length) : m_pData(data), m_iLength(length) {}
+
+            int Length() const
+            {
+                return m_iLength;
+            }
+
+            ushort At(int i) const  //Returns character with index i, or 0 if index is out of message
+            {
+                if(i < 0 || i >= m_iLength)
+                    return 0;
+                return qFromBigEndian<quint16>(m_pData + 2 * i);
+            }
+
+            int IndexOf(char ch, int from = 0) const    //Returns index of first ch since from, or -1 if not found
+            {
+                for(int i = from; i < m_iLength; i++)
+                    if(At(i) == ushort(ch))
+                        return i;
+                return -1;
+            }
+
+            int LastIndexOf(char ch) const  //Returns index of last ch, or -1 if not found
+            {
+                for(int i = m_iLength - 1; i >= 0; i--)
+                    if(At(i) == ushort(ch))
+                        return i;
+                return -1;
+            }
+
+            bool StartsWith(char c0, char c1) const
+            {
+                return At(0) == ushort(c0) && At(1) == ushort(c1);
+            }
+
+            //Converts characters in range [from, to) to integer like QString::toInt() does:
+            //surrounding spaces and sign are allowed, anything else gives 0.
+            int ToInt(int from, int to) const
+            {
+                if(to > m_iLength)
+                    to = m_iLength;
+                while(from < to && At(from) == ' ')
+                    from++;
+                while(to > from && At(to - 1) == ' ')
+                    to--;
+
+                bool negative = false;
+                if(from < to && (At(from) == '-' || At(from) == '+'))
+                    negative = At(from++) == '-';
+                if(from >= to)
+                    return 0;
+
+                qint64 value = 0;
+                for(int i = from; i < to; i++)
+                {
+                    ushort ch = At(i);
+                    if(ch < '0' || ch > '9')
+                        return 0;
+                    value = value * 10 + (ch - '0');
+                    if(value > qint64(2147483647) + (negative ? 1 : 0))   //Doesn't fit int
+                        return 0;
+                }
+                return int(negative ? -value : value);
+            }
+
+            //Copies characters in range [from, to) to QString. It allocates, so it's used only for text going to user.
+            QString ToString(int from = 0, int to = -1) const
+            {
+                QString result;
+                if(to < 0 || to > m_iLength)
+                    to = m_iLength;
+                if(from >= to)
+                    return result;
+                result.resize(to - from);
+                QChar* out = result.data();
+                for(int i = from; i < to; i++)
+                    out[i - from] = QChar(At(i));
+                return result;
+            }
+
+            //Converts characters in range [from, to) to unsigned 32-bit integer. Returns false if range is empty,
+            //has anything but digits (spaces and sign too) or value doesn't fit.
+            bool ToUInt32(int from, int to, quint32& value) const
+            {
+                value = 0;
+                if(to > m_iLength)
+                    to = m_iLength;
+                if(from >= to)
+                    return false;
+                quint64 result = 0;
+                for(int i = from; i < to; i++)
+                {
+                    ushort ch = At(i);
+                    if(ch < '0' || ch > '9')
+                        return false;
+                    result = result * 10 + (ch - '0');
+                    if(result > 0xFFFFFFFFull)
+                        return false;
+                }
+                value = quint32(result);
+                return true;
+            }
+
+            //Finds request ID at the end of message. Returns index where message without ID ends,
+            //or -1 if ID is malformed (sign, not a number or doesn't fit quint32). requestId is 0 then.
+            int SplitRequestId(quint32& requestId) const
+            {
+                requestId = 0;
+                int idPos = LastIndexOf('#');
+                if(idPos == -1)
+                    return m_iLength;
+                return ToUInt32(idPos + 1, m_iLength, requestId) ? idPos : -1;
+            }
+
+            //Finds serialized QString inside block of blockSize bytes. Returns false if block is malformed.
+            static bool FromBlock(const uchar* block, int blockSize, MessageView& view)
+            {
+                view = MessageView();
+                if(blockSize < 4)
+                    return false;
+                quint32 bytes = qFromBigEndian<quint32>(block);
+                if(bytes == 0xFFFFFFFF)     //Null string
+                    return true;
+                if(bytes % 2 != 0 || bytes > quint32(blockSize - 4))
+                    return false;
+                view = MessageView(block + 4, int(bytes / 2));
+                return true;
+            }
+        };
+
+        //Appends block with text message to the end of out. Bytes are the same as QDataStream writes,
+        //but they are encoded in place, without temporary arrays and seeking back for block size.
+        inline void AppendMessage(QByteArray& out, const QString& str)
+        {
+            int chars = str.size();
+            int offset = out.size();
+            out.resize(offset + int(sizeof(quint16) + sizeof(quint32)) + 2 * chars);
+            uchar* data = reinterpret_cast<uchar*>(out.data()) + offset;
+            qToBigEndian<quint16>(quint16(sizeof(quint32) + 2 * chars), data);     //Block size
+            qToBigEndian<quint32>(str.isNull() ? 0xFFFFFFFF : quint32(2 * chars), data + 2);  //String size in bytes
+            const ushort* characters = str.utf16();
+            for(int i = 0; i < chars; i++)
+                qToBigEndian<quint16>(characters[i], data + 6 + 2 * i);
+        }
+
+        //Command from client to AVR: <ActionCode>:<StepCount> or <ActionCode>, both may end with #<RequestID>.
+        //Trajectory has list of waypoints instead of step count: 9:<Waypoint>,<Waypoint>,...
+        struct Command
+        {
+            int code;
+            int steps;
+            int argsFrom;       //Index where text after ':' begins (trajectory's waypoints are parsed from there)
+            int argsTo;         //Index where it ends (request ID is not a part of it)
+            quint32 requestId;  //0 if command has no request ID
+        };
+
+        inline Command ParseCommand(const MessageView& msg)
+        {
+            Command command;
+            int end = msg.SplitRequestId(command.requestId);
+            if(end == -1)   //Malformed request ID, command is unknown message (code 0) and its reply has no ID
+            {
+                command.code = 0;
+                command.steps = 0;
+                command.argsFrom = command.argsTo = msg.Length();
+                return command;
+            }
+            int delimiterPos = msg.IndexOf(':');  //Finding ':' delimiter position
+            if(delimiterPos != -1 && delimiterPos < end)
+            {
+                command.code = msg.ToInt(0, delimiterPos);  //Message code
+                command.steps = msg.ToInt(delimiterPos + 1, end);  //Step count
+                command.argsFrom = delimiterPos + 1;
+            }
+            else    //If not found - whole message is message code
+            {
+                command.code = msg.ToInt(0, end);
+                command.steps = 0;
+                command.argsFrom = end;
+            }
+            command.argsTo = end;
+            return command;
+        }
+
+        //Parses comma-separated integers in range [from, to) of message, e.g. waypoints of trajectory.
+        //Returns count of values, or -1 if there are more than capacity of them.
+        inline int ParseList(const MessageView& msg, int from, int to, int* out, int capacity)
+        {
+            if(from >= to)
+                return 0;
+            int count = 0;
+            while(true)
+            {
+                int comma = msg.IndexOf(',', from);
+                if(comma == -1 || comma > to)
+                    comma = to;
+                if(count == capacity)
+                    return -1;
+                out[count++] = msg.ToInt(from, comma);
+                if(comma == to)
+                    return count;
+                from = comma + 1;
+            }
+        }
+
+        //Reply from AVR to client: \<Token><Arguments>
+        struct Reply
+        {
+            char token;     //Letter after '\', or 0 if message has no token
+            int arg0;       //\p and \h position, \i current position, \r action code, \v version, \w waypoint index
+            int arg1;       //\i maximum position, \r step count, \v device ID, \w position
+            bool hasArg1;   //Is second argument present
+            int textFrom;   //Index where text of \m (or \q report) message begins
+            int textTo;     //Index where text of \m (or \q report) message ends (request ID is not a part of text)
+            quint32 requestId;  //ID of request this is reply to, 0 if there is no ID
+        };
+
+        inline Reply ParseReply(const MessageView& msg)
+        {
+            Reply reply = {0, 0, 0, false, 2, msg.Length(), 0};
+            if(msg.At(0) != '\\')   //Check if special AVR message token exists (\p, \r, \m, etc.)
+                return reply;
+            reply.token = char(msg.At(1));
+            //Only these messages never have request ID. Metrics report of \q has '#' in its text.
+            if(reply.token != 'i' && reply.token != 'v' && reply.token != 't' && reply.token != 'q')
+            {
+                int idPos = msg.SplitRequestId(reply.requestId);
+                if(idPos != -1)
+                    reply.textTo = idPos;
+                else if(reply.token != 'm')     //Malformed request ID, reply can't be matched. Text may have '#' itself.
+                    reply.token = 0;
+            }
+            int end = reply.textTo;
+
+            int delimiterPos;
+            switch(reply.token)
+            {
+                case 'p':   //   \p<PositionNumber>
+                case 'h':   //   \h<PositionNumber>
+                case 't':   //   \t<PositionNumber>
+                    reply.arg0 = msg.ToInt(2, end);
+                    break;
+
+                case 'i':   //   \i<CurrentPosition>:<MaxPosition>
+                case 'v':   //   \v<Version>:<DeviceID>   or   \v<Version>
+                case 'r':   //   \r<MessageActionCode>:<StepCount>   or   \r<MessageActionCode>
+                case 'w':   //   \w<WaypointIndex>:<Position>
+                    delimiterPos = msg.IndexOf(':', 2);
+                    if(delimiterPos == -1 || delimiterPos >= end)
+                    {
+                        reply.arg0 = msg.ToInt(2, end);
+                        break;
+                    }
+                    reply.arg0 = msg.ToInt(2, delimiterPos);
+                    reply.hasArg1 = delimiterPos + 1 < end;
+                    reply.arg1 = msg.ToInt(delimiterPos + 1, end);
+                    break;
+            }
+            return reply;
+        }
+    }
+}